@@ -5,101 +5,57 @@
 #include "mlpbf/direction.h"
 #include "mlpbf/time.h"
 
+#include "mlpbf/console.h"
 #include "mlpbf/map.h"
 #include "mlpbf/database.h"
+#include "mlpbf/pathfinder.h"
 
 #include "mlpbf/utility/timer.h"
 
 #include <algorithm>
-#include <functional>
+#include <cassert>
+#include <cmath>
+#include <memory>
 #include <tuple>
 
 namespace bf
 {
 
-/***************************************************************************/
-
-class Actor::Action
+//-------------------------------------------------------------------------
+// Instruction layout -- op, dir, speed, arg
+//
+//	Move			dir, speed, tiles
+//	MoveTo			speed, index into m_targets
+//	Face			dir
+//	Reposition		index into m_targets
+//	WaitTime		milliseconds
+//	WaitHour		minutes since midnight
+//	RepeatTimes		iterations (0 repeats forever)
+//	RepeatUntil		minutes since midnight
+//	RepeatEnd		index of the matching repeat instruction
+//-------------------------------------------------------------------------
+enum Opcode
 {
-public:
-	Action() : m_init( false ) {}
-	virtual ~Action() {}
-
-	bool execute( Character & c )
-	{
-		if ( !m_init )
-		{
-			m_init = true;
-			init( c );
-		}
-		return play( c );
-	}
-	void reinit() { m_init = false; }
-
-private:
-	virtual void init( Character& ) = 0;
-	virtual bool play( Character& ) = 0;
-
-private:
-	bool m_init;
+	OpMove,
+	OpMoveTo,
+	OpFace,
+	OpReposition,
+	OpWaitTime,
+	OpWaitHour,
+	OpRepeatTimes,
+	OpRepeatUntil,
+	OpRepeatEnd
 };
 
-class Actor::Repeater : public Actor::Action
+inline sf::Uint32 toMinutes( const time::Hour& hour )
 {
-public:
-	Repeater( Repeater * last ) : 
-		m_lastRepeater( last ), 
-		m_index( 0U ) 
-	{}
-	
-	virtual ~Repeater() 
-	{ 
-		for ( Action * a : m_actions ) 
-			delete a; 
-	}
-
-	void addAction( Action * action ) 
-	{
-		m_actions.push_back( action ); 
-	}
-	
-	Repeater * getLastRepeater() 
-	{ 
-		return m_lastRepeater;
-	}
-
-private:
-	void init( Character & )
-	{
-		m_index = 0U;
-		onInit();
-	}
-	
-	bool play( Character & c )
-	{
-		while ( m_index < m_actions.size() && m_actions[ m_index ]->execute( c ) )
-		{
-			m_actions[ m_index ]->reinit();
-			if ( ++m_index == m_actions.size() )
-			{
-				if ( canFinish() )
-					return true;
-				else
-					m_index = 0;
-			}
-		}
-
-		return false;
-	}
-
-	virtual void onInit() = 0;
-	virtual bool canFinish() = 0;
+	return hour.get24Hour() * 60 + hour.getMinute();
+}
 
-private:
-	Repeater * const m_lastRepeater;
-	std::size_t m_index;
-	std::vector< Action * > m_actions;
-};
+inline time::Hour fromMinutes( sf::Uint32 minutes )
+{
+	return time::Hour( minutes / 60, minutes % 60 );
+}
 
 /***************************************************************************/
 
@@ -108,17 +64,23 @@ inline float distance( const sf::Vector2f& a, const sf::Vector2f& b )
 	return std::sqrt( std::pow( a.x - b.x, 2 ) + std::pow( a.y - b.y, 2 ) );
 }
 
-class Move : public Actor::Action
+// Walks a character a number of tiles (or pixels) in a straight line, following it across maps
+class Move
 {
 public:
-	Move( Direction d, MoveSpeed m, unsigned tiles ) :
-		m_dir( d ), m_speed( m ), m_tiles( tiles ), m_distance( 0.0f )
+	Move() : m_dir( Down ), m_speed( Idle ), m_length( 0.0f ), m_distance( 0.0f ) {}
+
+	void init( Character& c, Direction d, MoveSpeed m, unsigned tiles )
 	{
+		walk( c, d, m, tiles * (float) ( ( d == Left || d == Right ) ? TILE_WIDTH : TILE_HEIGHT ) );
 	}
 
-private:
-	void init( Character& c )
+	void walk( Character& c, Direction d, MoveSpeed m, float length )
 	{
+		m_dir = d;
+		m_speed = m;
+		m_length = length;
+
 		m_distance = 0.0f;
 		m_last = std::make_tuple( c.getMapID(), c.getPosition() );
 		c.setMovement( m_speed, m_dir );
@@ -127,10 +89,10 @@ private:
 		m_destPos = c.getPosition();
 		switch ( m_dir )
 		{
-		case Up:	m_destPos.y -= m_tiles * TILE_HEIGHT; break;
-		case Down:	m_destPos.y += m_tiles * TILE_HEIGHT; break;
-		case Left:	m_destPos.x -= m_tiles * TILE_WIDTH;  break;
-		case Right:	m_destPos.x += m_tiles * TILE_WIDTH;  break;
+		case Up:	m_destPos.y -= m_length; break;
+		case Down:	m_destPos.y += m_length; break;
+		case Left:	m_destPos.x -= m_length; break;
+		case Right:	m_destPos.x += m_length; break;
 		}
 	}
 
@@ -142,38 +104,36 @@ private:
 		{
 			const Map& lastMap = db::getMap( std::get< 0 >( m_last ) );
 			const sf::Vector2f& lastPos = std::get< 1 >( m_last );
-			sf::Vector2f pos( lastPos );
 
+			// Bring the position into the last map's coordinates, and the destination into the new map's
+			sf::Vector2f shift;
 			switch ( c.getDirection() )
 			{
 			case Up:
-				pos.y = ( lastMap.getNeighbor( Up )->getHeight() * TILE_HEIGHT - lastPos.y ) - c.getPosition().y;
-				m_destPos.y += lastMap.getHeight() * TILE_HEIGHT;
+				shift = sf::Vector2f( (float) lastMap.getNeighborOffset( Up ) * TILE_WIDTH, (float) lastMap.getNeighbor( Up )->getHeight() * TILE_HEIGHT );
 			break;
 
 			case Down:
-				pos.y = c.getPosition().y + lastMap.getHeight() * TILE_HEIGHT;
-				m_destPos.y -= lastMap.getHeight() * TILE_HEIGHT;
+				shift = sf::Vector2f( (float) lastMap.getNeighborOffset( Down ) * TILE_WIDTH, -(float) lastMap.getHeight() * TILE_HEIGHT );
 			break;
 
 			case Left:
-				pos.x = ( lastMap.getNeighbor( Left )->getWidth() * TILE_WIDTH - lastPos.x ) - c.getPosition().x;
-				m_destPos.x += lastMap.getWidth() * TILE_WIDTH;
+				shift = sf::Vector2f( (float) lastMap.getNeighbor( Left )->getWidth() * TILE_WIDTH, (float) lastMap.getNeighborOffset( Left ) * TILE_HEIGHT );
 			break;
 
 			case Right:
-				pos.x = c.getPosition().x + lastMap.getWidth() * TILE_WIDTH;
-				m_destPos.x -= lastMap.getWidth() * TILE_WIDTH;
+				shift = sf::Vector2f( -(float) lastMap.getWidth() * TILE_WIDTH, (float) lastMap.getNeighborOffset( Right ) * TILE_HEIGHT );
 			break;
 			}
 
+			sf::Vector2f pos = c.getPosition() - shift;
+			m_destPos += shift;
+
 			m_distance += distance( lastPos, pos );
 		}
 
-		float size = ( m_dir == Left || m_dir == Right ) ? (float) TILE_WIDTH  : (float) TILE_HEIGHT;
-
 		m_last = std::make_tuple( c.getMapID(), c.getPosition() );
-		bool complete = m_distance >= m_tiles * size;
+		bool complete = m_distance >= m_length;
 
 		if ( complete )
 		{
@@ -185,9 +145,9 @@ private:
 	}
 
 private:
-	const Direction m_dir;
-	const MoveSpeed m_speed;
-	const unsigned m_tiles;
+	Direction m_dir;
+	MoveSpeed m_speed;
+	float m_length;
 
 	std::tuple< unsigned, sf::Vector2f > m_last;
 	float m_distance;
@@ -196,198 +156,341 @@ private:
 
 /***************************************************************************/
 
-class Face : public Actor::Action
+// Walks a character to a tile along a planned path, one map at a time
+class MoveTo
 {
 public:
-	Face( Direction d ) : m_dir( d )
-	{
-	}
+	MoveTo() : m_speed( Walk ), m_stage( 0U ), m_index( 0U ), m_moving( false ) {}
 
-private:
-	void init( Character& c )
+	void init( Character& c, const sf::Vector2i& tile, const std::string& map, MoveSpeed m )
 	{
-		c.setMovement( Idle, m_dir );
-	}
+		m_tile = tile;
+		m_speed = m;
 
-	bool play( Character& c )
-	{
-		return true;
-	}
+		m_route.clear();
+		m_legs.clear();
+		m_moving = false;
+		m_stage = m_index = 0U;
 
-private:
-	const Direction m_dir;
-};
+		if ( m_tile.x < 0 || m_tile.y < 0 )
+		{
+			Console::singleton() << con::setcerr << "moveTo: (" << m_tile.x << ", " << m_tile.y << ") is not a tile" << con::endl;
+			return;
+		}
 
-/***************************************************************************/
+		sf::Vector2u from = getTile( c );
 
-class Reposition : public Actor::Action
-{
-public:
-	Reposition( const sf::Vector2i& pos, const std::string& map ) :
-		m_pos( pos.x * TILE_WIDTH + ( TILE_WIDTH / 2.0f ), pos.y * TILE_HEIGHT + ( TILE_HEIGHT / 2.0f ) ), 
-		m_map( map )
-	{
-	}
+		// Plan the maps to cross on the way; each stage then walks to the next crossing
+		const Map& current = db::getMap( c.getMapID() );
+		const Map& dest = map.empty() ? current : db::getMap( map );
+		if ( dest.getID() != current.getID() && !Pathfinder::singleton().route( current, from, dest, sf::Vector2u( m_tile ), m_route ) )
+		{
+			Console::singleton() << con::setcerr << "moveTo: no route to \"" << map << "\"" << con::endl;
+			return;
+		}
 
-private:
-	void init( Character& c )
-	{
-		if ( m_map.empty() )
-			c.setPosition( m_pos );
-		else
-			c.setMap( m_map, m_pos );
+		planStage( c );
 	}
 
 	bool play( Character& c )
 	{
+		while ( m_moving )
+		{
+			if ( !m_move.play( c ) )
+				return false;
+			nextLeg( c );
+
+			if ( !m_moving && m_stage < m_route.size() )
+			{
+				m_stage++;
+				planStage( c );
+			}
+		}
 		return true;
 	}
 
 private:
-	const sf::Vector2f m_pos;
-	const std::string m_map;
-};
-
-/***************************************************************************/
-
-class WaitTime : public Actor::Action
-{
-public:
-	WaitTime( const sf::Time& time )
+	static sf::Vector2u getTile( const Character& c )
 	{
-		m_timer.setTarget( time );
+		return sf::Vector2u( (unsigned) c.getPosition().x / TILE_WIDTH, (unsigned) c.getPosition().y / TILE_HEIGHT );
 	}
 
-private:
-	void init( Character& )
+	void planStage( Character& c )
 	{
-		m_timer.restart();
-		m_timer.setState( true );
-	}
+		m_legs.clear();
+		m_index = 0U;
 
-	bool play( Character& )
-	{
-		return m_timer.finished();
-	}
+		const bool crossing = m_stage < m_route.size();
+		const sf::Vector2u from = getTile( c ), to = crossing ? m_route[ m_stage ].tile : sf::Vector2u( m_tile );
 
-private:
-	util::Timer m_timer;
-};
+		if ( !Pathfinder::singleton().find( db::getMap( c.getMapID() ), from, to, m_path ) )
+		{
+			Console::singleton() << con::setcerr << "moveTo: no path to (" << to.x << ", " << to.y << ")" << con::endl;
+			m_route.clear();
+			m_moving = false;
+			return;
+		}
 
-class WaitHour : public Actor::Action
-{
-public:
-	WaitHour( const time::Hour& hour ) :
-		m_hour( hour )
-	{
+		// Collapse the path into straight legs
+		sf::Vector2u last = from;
+		for ( const sf::Vector2u& tile : m_path )
+		{
+			addLeg( tile.x > last.x ? Right : tile.x < last.x ? Left : tile.y > last.y ? Down : Up );
+			last = tile;
+		}
+
+		// Step off the edge into the next map
+		if ( crossing )
+			addLeg( m_route[ m_stage ].dir );
+
+		// Walk onto the center of the starting tile, so each leg ends on a tile center:
+		// the first leg absorbs the offset along its own axis, a short leg in front covers the other
+		sf::Vector2f offset = c.getPosition() - sf::Vector2f( ( from.x + 0.5f ) * TILE_WIDTH, ( from.y + 0.5f ) * TILE_HEIGHT );
+		const bool horizontal = !m_legs.empty() && ( m_legs[ 0 ].first == Left || m_legs[ 0 ].first == Right );
+		const bool vertical = !m_legs.empty() && !horizontal;
+
+		if ( horizontal )
+			m_legs[ 0 ].second += m_legs[ 0 ].first == Right ? -offset.x : offset.x;
+		if ( vertical )
+			m_legs[ 0 ].second += m_legs[ 0 ].first == Down ? -offset.y : offset.y;
+
+		if ( !horizontal && offset.x != 0.0f )
+			m_legs.insert( m_legs.begin(), std::make_pair( offset.x > 0.0f ? Left : Right, std::abs( offset.x ) ) );
+		if ( !vertical && offset.y != 0.0f )
+			m_legs.insert( m_legs.begin(), std::make_pair( offset.y > 0.0f ? Up : Down, std::abs( offset.y ) ) );
+
+		nextLeg( c );
 	}
 
-private:
-	void init( Character& )
+	void addLeg( Direction d )
 	{
+		float size = ( d == Left || d == Right ) ? (float) TILE_WIDTH : (float) TILE_HEIGHT;
+		if ( !m_legs.empty() && m_legs.back().first == d )
+			m_legs.back().second += size;
+		else
+			m_legs.push_back( std::make_pair( d, size ) );
 	}
 
-	bool play( Character& )
+	void nextLeg( Character& c )
 	{
-		return Time::singleton().getHour() >= m_hour;
+		m_moving = m_index < m_legs.size();
+		if ( m_moving )
+		{
+			m_move.walk( c, m_legs[ m_index ].first, m_speed, m_legs[ m_index ].second );
+			m_index++;
+		}
 	}
 
 private:
-	const time::Hour m_hour;
+	sf::Vector2i m_tile;
+	MoveSpeed m_speed;
+
+	std::vector< Pathfinder::Crossing > m_route;
+	std::size_t m_stage;
+
+	std::vector< sf::Vector2u > m_path;
+	std::vector< std::pair< Direction, float > > m_legs; // Direction and length in pixels
+	std::size_t m_index;
+
+	Move m_move;
+	bool m_moving;
 };
 
 /***************************************************************************/
 
-class RepeaterNumTimes : public Actor::Repeater
+//-------------------------------------------------------------------------
+// Holds the state of the instruction being run
+// Only one instruction runs at a time, so one of each is reused for the actor's lifetime
+//-------------------------------------------------------------------------
+class Actor::Runner
 {
 public:
-	RepeaterNumTimes( Repeater* last, unsigned numTimes ) :
-		Repeater( last ),
-		m_numTimes( numTimes ),
-		m_loops( 0U )
-	{
-	}
-
-private:
-	void onInit()
-	{
-		m_loops = 0U;
-	}
+	Move move;
+	MoveTo moveTo;
+	util::Timer timer;
 
-	bool canFinish()
-	{
-		return ++m_loops == m_numTimes;
-	}
-
-private:
-	const unsigned m_numTimes;
-	unsigned m_loops;
+	// Set by the scheduler when a wait for an hour is over; shared so a late wake-up after the actor is gone is harmless
+	std::shared_ptr< bool > woken;
 };
 
 /***************************************************************************/
 
+Actor::Actor() :
+	m_pc( 0U ),
+	m_started( false ),
+	m_runner( new Runner() )
+{
+}
+
 Actor::~Actor()
 {
-	for ( Action * a : m_actions )
-		delete a;
 }
 
 Actor & Actor::move( Direction dir, MoveSpeed speed, unsigned tiles )
 {
-	return addAction( new Move( dir, speed, tiles ) );
+	return addInstruction( OpMove, tiles, dir, speed );
+}
+
+Actor & Actor::moveTo( const sf::Vector2i & tile, const std::string & map, MoveSpeed speed )
+{
+	return addInstruction( OpMoveTo, addTarget( tile, map ), 0, speed );
 }
 
 Actor & Actor::face( Direction dir, bool force )
 {
 	//TODO: force direction
-	return addAction( new Face( dir ) );
+	return addInstruction( OpFace, 0U, dir );
 }
 
 Actor & Actor::reposition( const sf::Vector2i & pos, const std::string & map )
 {
-	return addAction( new Reposition( pos, map ) );
+	return addInstruction( OpReposition, addTarget( pos, map ) );
 }
 
 Actor & Actor::wait( const sf::Time & time )
 {
-	return addAction( new WaitTime( time ) );
+	return addInstruction( OpWaitTime, std::max( 0, time.asMilliseconds() ) );
 }
 
 Actor & Actor::wait( const time::Hour & hour )
 {
-	return addAction( new WaitHour( hour ) );
+	return addInstruction( OpWaitHour, toMinutes( hour ) );
 }
 
 Actor & Actor::repeatBegin( unsigned numTimes )
 {
-	RepeaterNumTimes* a = new RepeaterNumTimes( m_curRepeater, numTimes );
-	addAction( a );
-	m_curRepeater = a;
-	return *this;
+	m_open.push_back( m_program.size() );
+	return addInstruction( OpRepeatTimes, numTimes );
+}
+
+Actor & Actor::repeatBegin( const time::Hour & hour )
+{
+	m_open.push_back( m_program.size() );
+	return addInstruction( OpRepeatUntil, toMinutes( hour ) );
 }
 
 Actor & Actor::repeatEnd()
 {
-	assert( m_curRepeater != nullptr );
-	m_curRepeater = m_curRepeater->getLastRepeater();
+	assert( !m_open.empty() );
+	addInstruction( OpRepeatEnd, m_open.back() );
+	m_open.pop_back();
 	return *this;
 }
 
 void Actor::updateCharacter( Character & c )
 {
-	while ( !m_actions.empty() && ( *m_actions.begin() )->execute( c ) )
-		m_actions.erase( m_actions.begin() );
+	while ( m_pc < m_program.size() )
+	{
+		const Instruction in = m_program[ m_pc ];
+		bool first = !m_started;
+		m_started = true;
+
+		switch ( in.op )
+		{
+		case OpMove:
+			if ( first ) m_runner->move.init( c, (Direction) in.dir, (MoveSpeed) in.speed, in.arg );
+			if ( !m_runner->move.play( c ) ) return;
+		break;
+
+		case OpMoveTo:
+			if ( first ) m_runner->moveTo.init( c, m_targets[ in.arg ].first, m_targets[ in.arg ].second, (MoveSpeed) in.speed );
+			if ( !m_runner->moveTo.play( c ) ) return;
+		break;
+
+		case OpFace:
+			c.setMovement( Idle, (Direction) in.dir );
+		break;
+
+		case OpReposition:
+		{
+			const sf::Vector2i& tile = m_targets[ in.arg ].first;
+			const sf::Vector2f pos( tile.x * TILE_WIDTH + ( TILE_WIDTH / 2.0f ), tile.y * TILE_HEIGHT + ( TILE_HEIGHT / 2.0f ) );
+
+			if ( m_targets[ in.arg ].second.empty() )
+				c.setPosition( pos );
+			else
+				c.setMap( m_targets[ in.arg ].second, pos );
+		}
+		break;
+
+		case OpWaitTime:
+			if ( first )
+			{
+				m_runner->timer.setTarget( sf::milliseconds( in.arg ) );
+				m_runner->timer.setState( true );
+			}
+			if ( !m_runner->timer.finished() ) return;
+		break;
+
+		case OpWaitHour:
+			if ( first )
+			{
+				Time& t = Time::singleton();
+				const time::Hour hour = fromMinutes( in.arg );
+
+				std::shared_ptr< bool > woken( new bool( t.getHour() >= hour ) );
+				if ( !*woken )
+					t.getScheduler().at( t.getMinutes( hour ), [woken]() { *woken = true; } );
+				m_runner->woken = woken;
+			}
+			if ( !*m_runner->woken ) return;
+		break;
+
+		case OpRepeatTimes:
+		case OpRepeatUntil:
+		{
+			Loop loop = { (sf::Uint32) m_pc + 1, in.arg };
+			m_loops.push_back( loop );
+		}
+		break;
+
+		case OpRepeatEnd:
+		{
+			Loop& loop = m_loops.back();
+			bool done;
+			if ( m_program[ in.arg ].op == OpRepeatUntil )
+				done = Time::singleton().getHour() >= fromMinutes( loop.count );
+			else
+				done = loop.count != 0U && --loop.count == 0U;
+
+			if ( !done )
+			{
+				m_pc = loop.begin;
+				m_started = false;
+				continue;
+			}
+			m_loops.pop_back();
+		}
+		break;
+		}
+
+		m_pc++;
+		m_started = false;
+	}
+
+	// Release the program once it has run out, unless a repeat is still being built
+	if ( !m_program.empty() && m_open.empty() )
+	{
+		m_program.clear();
+		m_targets.clear();
+		m_loops.clear();
+		m_pc = 0U;
+	}
 }
 
-Actor & Actor::addAction( Action * action )
+Actor & Actor::addInstruction( sf::Uint8 op, sf::Uint32 arg, sf::Uint8 dir, sf::Uint8 speed )
 {
-	if ( m_curRepeater )
-		m_curRepeater->addAction( action );
-	else
-		m_actions.push_back( action );
+	Instruction in = { op, dir, speed, arg };
+	m_program.push_back( in );
 	return *this;
 }
 
+sf::Uint32 Actor::addTarget( const sf::Vector2i & tile, const std::string & map )
+{
+	m_targets.push_back( std::make_pair( tile, map ) );
+	return m_targets.size() - 1;
+}
+
 /***************************************************************************/
 
 } // namespace bf
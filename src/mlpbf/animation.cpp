@@ -1,5 +1,4 @@
 #include "mlpbf/graphics/animation.h"
-#include "mlpbf/utility/timer.h"
 
 #include "mlpbf/exception.h"
 #include "mlpbf/resource.h"
@@ -46,9 +45,9 @@ Animation::Animation( const TiXmlElement& elem ) :
 	m_dim.y = attribute( elem, "height" );
 
 	m_numFrames = attribute( elem, "frames" );
-	m_frameTime = attribute( elem, "frame_time" );
+	m_frameTime = sf::milliseconds( attribute( elem, "frame_time" ) ).asMicroseconds();
 
-	loadTexture( xml::attribute( elem, "image" ) );
+	loadRegion( xml::attribute( elem, "image" ) );
 
 	// Optional
 
@@ -57,31 +56,23 @@ Animation::Animation( const TiXmlElement& elem ) :
 
 	const char* flip = elem.Attribute( "flip" );
 	if ( flip ) std::istringstream( flip ) >> std::boolalpha >> m_flip;
+
+	// Get the subrect of each frame, in play order
+	const sf::IntRect& image = getRegion().rect;
+	for ( unsigned i = 0; i < m_numFrames; i++ )
+	{
+		unsigned frame = m_reverse ? m_numFrames - 1 - i : i;
+		m_frames.push_back( sf::IntRect( image.left + frame * m_dim.x, image.top, m_dim.x, m_dim.y ) );
+	}
 }
 
 void Animation::update( sf::Sprite& sprite, unsigned frame ) const
 {
-	if ( m_reverse ) frame = m_numFrames - frame;
-	frame = std::min( m_numFrames - 1, std::max( frame, 0U ) );
-
 	sprite.scale( ( m_flip ) ? -1.0f : 1.0f, 1.0f );
-	sprite.setTexture( getTexture() );
+	sprite.setTexture( *getRegion().texture );
 
 	sprite.setOrigin( m_dim.x / 2.0f, m_dim.y / 2.0f );
-
-	// Get the subrect to draw
-	sf::IntRect subrect;
-	subrect.left	= frame * m_dim.x;
-	subrect.top		= 0;
-	subrect.width	= m_dim.x;
-	subrect.height	= m_dim.y;
-
-	sprite.setTextureRect( subrect );
-}
-
-void Animation::setTimer( util::Timer& timer ) const
-{
-	timer.setTarget( sf::milliseconds( m_frameTime ) );
+	sprite.setTextureRect( getFrameRect( frame ) );
 }
 
 /***************************************************************************/
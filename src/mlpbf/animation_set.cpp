@@ -0,0 +1,40 @@
+#include "mlpbf/graphics/animation_set.h"
+
+#include <tinyxml.h>
+
+namespace bf
+{
+namespace gfx
+{
+
+/***************************************************************************/
+
+AnimationSet::AnimationSet( const TiXmlElement& root ) :
+	m_movement()
+{
+	const TiXmlNode * it = nullptr;
+	while ( ( it = root.IterateChildren( "animation", it ) ) )
+	{
+		std::unique_ptr< Animation > anim( new Animation( static_cast< const TiXmlElement& >( *it ) ) );
+		std::string id = anim->getID();
+
+		//TODO: check if already exists
+		m_animations.insert( std::make_pair( id, std::move( anim ) ) );
+	}
+
+	for ( int d = Up; d <= Right; d++ )
+		for ( int m = Idle; m < SPEED_COUNT; m++ )
+			m_movement[ d * SPEED_COUNT + m ] = find( strDirection( (Direction) d ) + "." + strMoveSpeed( (MoveSpeed) m ) );
+}
+
+const Animation* AnimationSet::find( const std::string& id ) const
+{
+	auto find = m_animations.find( id );
+	return ( find != m_animations.end() ) ? find->second.get() : nullptr;
+}
+
+/***************************************************************************/
+
+} // namespace gfx
+
+} // namespace bf
@@ -0,0 +1,99 @@
+#include "mlpbf/graphics/animator.h"
+#include "mlpbf/graphics/animation.h"
+#include "mlpbf/utility/tick.h"
+
+namespace bf
+{
+namespace gfx
+{
+
+/***************************************************************************/
+
+Animator& Animator::singleton()
+{
+	static Animator a;
+	return a;
+}
+
+Animator::Animator() :
+	m_last( util::now( util::Game ) )
+{
+}
+
+/***************************************************************************/
+
+unsigned Animator::add()
+{
+	Record r = { nullptr, 0, 0U, false, false };
+
+	if ( !m_free.empty() )
+	{
+		unsigned id = m_free.back();
+		m_free.pop_back();
+		m_records[ id ] = r;
+		return id;
+	}
+
+	m_records.push_back( r );
+	return m_records.size() - 1;
+}
+
+void Animator::remove( unsigned id )
+{
+	m_records[ id ].anim = nullptr;
+	m_free.push_back( id );
+}
+
+void Animator::play( unsigned id, const Animation* anim, bool loop )
+{
+	Record& r = m_records[ id ];
+	r.anim = anim;
+	r.elapsed = 0;
+	r.frame = 0U;
+	r.loop = loop;
+	r.finished = false;
+}
+
+/***************************************************************************/
+
+void Animator::update()
+{
+	sf::Int64 now = util::now( util::Game ), dt = now - m_last;
+	m_last = now;
+
+	if ( dt <= 0 )
+		return;
+
+	for ( Record& r : m_records )
+	{
+		if ( !r.anim || r.finished )
+			continue;
+
+		const sf::Int64 frameTime = r.anim->getFrameTime();
+		const unsigned frames = r.anim->getNumFrames();
+
+		r.elapsed += dt;
+		if ( r.elapsed < frameTime )
+			continue;
+
+		sf::Int64 steps = r.elapsed / frameTime;
+		r.elapsed %= frameTime;
+
+		if ( r.loop )
+			r.frame = (unsigned) ( ( r.frame + steps ) % frames );
+		else if ( r.frame + steps >= frames )
+		{
+			r.frame = frames - 1;
+			r.elapsed = 0;
+			r.finished = true;
+		}
+		else
+			r.frame += (unsigned) steps;
+	}
+}
+
+/***************************************************************************/
+
+} // namespace gfx
+
+} // namespace bf
@@ -6,7 +6,8 @@
 #include "mlpbf/database.h"
 #include "mlpbf/exception.h"
 
-#include <sstream>
+#include <algorithm>
+#include <cmath>
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
 
@@ -60,10 +61,8 @@ inline sf::Vector2f getMoveSpeed( MoveSpeed m, Direction d )
 	throw Exception( "getMoveSpeed could not generate a move speed" );
 }
 
-sf::Vector2u convert( const sf::Vector2f& pos )
-{
-	return sf::Vector2u( (int) pos.x / TILE_WIDTH, (int) pos.y / TILE_HEIGHT );
-}
+// Gap, in pixels, kept between a character and what it collided with
+static const float COLLISION_SKIN = 0.01f;
 
 /***************************************************************************/
 
@@ -85,105 +84,46 @@ void Character::setMap( const std::string& map )
 void Character::setMap( const std::string& map, const sf::Vector2f& pos )
 {
 	m_mapID = db::getMap( map ).getID();
-	m_pos = pos;
+	setPosition( pos );
 }
 
 void Character::update( const sf::Time& time )
 {
+	m_prevPos = m_pos;
+
 	updateCharacter( *this );
 
 	const Map& m = db::getMap( m_mapID );
 
-	sf::Vector2f move = std::get< 1 >( m_move ) * ( time.asMilliseconds() / 10.0f );
+	sf::Vector2f move = std::get< 1 >( m_move ) * ( time.asMicroseconds() / 10000.0f );
 	if ( move == sf::Vector2f( 0.0f, 0.0f ) ) return;
 
-	// Move the character bounds
-	sf::FloatRect bound = getBounds();
-
-	// Check for collision depending on direction
+	// Check for collision along the move, sliding along whatever was hit
 	if ( m_checkCollision )
 	{
-		sf::Vector2f checkA, checkB;
+		sf::FloatRect bound = getBounds();
 		bool collision = false;
-	
-		//TODO: factor out code
-		switch ( std::get< 0 >( m_move ) )
+
+		for ( int pass = 0; pass < 2 && move != sf::Vector2f( 0.0f, 0.0f ); pass++ )
 		{
-		case Up: // Top-left and top-right
-			checkA = sf::Vector2f( bound.left, bound.top + move.y );
-			checkB = sf::Vector2f( bound.left + bound.width, checkA.y );
-
-			while ( m.checkTileCollision( convert( checkA ) ) || m.checkObjectCollision( checkA ) ||
-					m.checkTileCollision( convert( checkB ) ) || m.checkObjectCollision( checkB ) )
-			{
-				if ( !collision )
-				{
-					checkA.y = checkB.y = std::floor( checkB.y / TILE_HEIGHT ) * TILE_HEIGHT + 1.0f;
-					collision = true;
-				}
-				else
-					checkA.y = checkB.y += TILE_HEIGHT;
-			}
-
-			bound.top = checkA.y;
-		break;
-
-		case Down: // Bottom-left and bottom-right
-			checkA = sf::Vector2f( bound.left, bound.top + bound.height + move.y );
-			checkB = sf::Vector2f( bound.left + bound.width, checkA.y );
-
-			while ( m.checkTileCollision( convert( checkA ) ) || m.checkObjectCollision( checkA ) ||
-					m.checkTileCollision( convert( checkB ) ) || m.checkObjectCollision( checkB ) )
-			{
-				if ( !collision )
-				{
-					checkA.y = checkB.y = std::ceil( checkB.y / TILE_HEIGHT ) * TILE_HEIGHT - 1.0f;
-					collision = true;
-				}
-				else
-					checkA.y = checkB.y += -TILE_HEIGHT;
-			}
-
-			bound.top = checkA.y - bound.height;
-		break;
-
-		case Left: // Top-left and bottom-left
-			checkA = sf::Vector2f( bound.left + move.x, bound.top ); 
-			checkB = sf::Vector2f( checkA.x, bound.top + bound.height );
-
-			while ( m.checkTileCollision( convert( checkA ) ) || m.checkObjectCollision( checkA ) ||
-					m.checkTileCollision( convert( checkB ) ) || m.checkObjectCollision( checkB ) )
-			{
-				if ( !collision )
-				{
-					checkA.x = checkB.x = std::floor( checkB.x / TILE_WIDTH ) * TILE_WIDTH + 1.0f;
-					collision = true;
-				}
-				else
-					checkA.x = checkB.x += TILE_WIDTH;
-			}
-
-			bound.left = checkA.x;
-		break;
-
-		case Right:	// Top-right and bottom-right
-			checkA = sf::Vector2f( bound.left + bound.width + move.x, bound.top );
-			checkB = sf::Vector2f( checkA.x, bound.top + bound.height );
-
-			while ( m.checkTileCollision( convert( checkA ) ) || m.checkObjectCollision( checkA ) ||
-					m.checkTileCollision( convert( checkB ) ) || m.checkObjectCollision( checkB ) )
-			{
-				if ( !collision )
-				{
-					checkA.x = checkB.x = std::ceil( checkB.x / TILE_WIDTH ) * TILE_WIDTH - 1.0f;
-					collision = true;
-				}
-				else
-					checkA.x = checkB.x += -TILE_WIDTH;
-			}
-
-			bound.left = checkA.x - bound.width;
-		break;
+			Map::Contact contact = m.sweep( bound, move );
+
+			// Stop just short of the contact so the next sweep doesn't start inside it
+			float fraction = contact.time;
+			if ( fraction < 1.0f )
+				fraction = std::max( 0.0f, fraction - COLLISION_SKIN / std::max( std::abs( move.x ), std::abs( move.y ) ) );
+
+			bound.left += move.x * fraction;
+			bound.top += move.y * fraction;
+
+			if ( contact.time >= 1.0f )
+				break;
+
+			// Keep the part of the remaining move that runs along the surface
+			move *= 1.0f - contact.time;
+			if ( contact.normal.x != 0.0f ) move.x = 0.0f;
+			if ( contact.normal.y != 0.0f ) move.y = 0.0f;
+			collision = move == sf::Vector2f( 0.0f, 0.0f );
 		}
 
 		if ( collision )
@@ -198,12 +138,13 @@ void Character::update( const sf::Time& time )
 		m_pos += move;
 
 	// Change the character's current map if they left the map bounds
+	const sf::Vector2f before = m_pos;
 	const Map& curMap = db::getMap( m_mapID ), *nextMap = nullptr;
 	if ( ( nextMap = curMap.getNeighbor( Up ) ) != nullptr && m_pos.y < 0.0f )
 	{
 		m_mapID = nextMap->getID();
 		m_pos.x = m_pos.x + ( curMap.getNeighborOffset( Up ) * TILE_WIDTH );
-		m_pos.y = nextMap->getHeight() * TILE_HEIGHT - m_pos.y;
+		m_pos.y = nextMap->getHeight() * TILE_HEIGHT + m_pos.y;
 	}
 	else if ( ( nextMap = curMap.getNeighbor( Down ) ) != nullptr && curMap.getHeight() * TILE_HEIGHT <= m_pos.y )
 	{
@@ -214,7 +155,7 @@ void Character::update( const sf::Time& time )
 	else if ( ( nextMap = curMap.getNeighbor( Left ) ) != nullptr && m_pos.x < 0.0f )
 	{
 		m_mapID = nextMap->getID();
-		m_pos.x = nextMap->getWidth() * TILE_WIDTH - m_pos.x;
+		m_pos.x = nextMap->getWidth() * TILE_WIDTH + m_pos.x;
 		m_pos.y = m_pos.y + ( curMap.getNeighborOffset( Left ) * TILE_HEIGHT );
 	}
 	else if ( ( nextMap = curMap.getNeighbor( Right ) ) != nullptr && curMap.getWidth() * TILE_WIDTH <= m_pos.x )
@@ -223,6 +164,9 @@ void Character::update( const sf::Time& time )
 		m_pos.x = m_pos.x - ( curMap.getWidth() * TILE_WIDTH );
 		m_pos.y = m_pos.y + ( curMap.getNeighborOffset( Right ) * TILE_HEIGHT );
 	}
+
+	// Keep the last position in the same map's coordinates
+	m_prevPos += m_pos - before;
 }
 
 void Character::setMovement( MoveSpeed m, Direction d )
@@ -230,10 +174,7 @@ void Character::setMovement( MoveSpeed m, Direction d )
 	if ( std::get< 2 >( m_move ) && std::get< 0 >( m_move ) == d )
 		return;
 
-	std::ostringstream ss;
-	ss << strDirection( d ) << "." << strMoveSpeed( m );
-
-	m_sheet.animate( ss.str(), true );
+	m_sheet.animate( d, m, true );
 	m_move = std::make_tuple( d, getMoveSpeed( m, d ), false );
 }
 
@@ -249,7 +190,7 @@ sf::Sprite Character::toSprite() const
 {
 	sf::Sprite sprite;
 
-	sprite.setPosition( m_pos );
+	sprite.setPosition( m_drawPos );
 	m_sheet.update( sprite );
 
 	return sprite;
@@ -4,10 +4,13 @@
 #include "mlpbf/database.h"
 #include "mlpbf/global.h"
 #include "mlpbf/lua.h"
+#include "mlpbf/lua/allocator.h"
+#include "mlpbf/lua/profiler.h"
 #include "mlpbf/map.h"
 #include "mlpbf/player.h"
 #include "mlpbf/time.h"
 #include "mlpbf/exception.h"
+#include "mlpbf/utility/tick.h"
 
 #include <functional>
 #include <sstream>
@@ -160,6 +163,35 @@ class DebugCollision : public con::Command
 	}
 };
 
+class CacheMapLayers : public con::Command
+{
+	const std::string name() const
+	{
+		return "cache_map_layers";
+	}
+
+	unsigned minArgs() const
+	{
+		return 1;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Renders static map layers from cached textures" << endl;
+		c << setcinfo << "cache_map_layers true/false" << endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		std::istringstream( args[ 0 ] ) >> std::boolalpha >> bf::CACHE_MAP_LAYERS;
+
+		// Nothing draws from the caches anymore, so free their textures
+		if ( !bf::CACHE_MAP_LAYERS )
+			for ( unsigned i = 0; i < db::getMapCount(); i++ )
+				db::getMap( i ).releaseCaches();
+	}
+};
+
 class GetTime : public con::Command
 {
 	const std::string name() const
@@ -207,6 +239,78 @@ class Timescale : public con::Command
 	}
 };
 
+class GameSpeed : public con::Command
+{
+	const std::string name() const
+	{
+		return "gamespeed";
+	}
+
+	unsigned minArgs() const
+	{
+		return 1;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Pauses, resumes, or scales the speed of the game world; the interface keeps running" << con::endl;
+		c << setcinfo << "gamespeed pause|resume|scale" << con::endl;
+		c << setcinfo << "scale: number, greater than or equal to 0" << con::endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		if ( args[ 0 ] == "pause" )
+			util::setPaused( util::Game, true );
+		else if ( args[ 0 ] == "resume" )
+			util::setPaused( util::Game, false );
+		else
+		{
+			float scale = std::stof( args[ 0 ] );
+			if ( scale < 0.0f )
+				throw Exception( "Game speed must be greater than or equal to 0" );
+			util::setScale( util::Game, scale );
+		}
+
+		c << setcinfo << "Game speed: " << util::getScale( util::Game ) << ( util::isPaused( util::Game ) ? " (paused)" : "" ) << con::endl;
+	}
+};
+
+class Sleep : public con::Command
+{
+	const std::string name() const
+	{
+		return "sleep";
+	}
+
+	unsigned minArgs() const
+	{
+		return 0;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Skips ahead to an hour (default: 6:00 AM)" << con::endl;
+		c << setcinfo << "Usage: sleep [hour]" << con::endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		std::string hour = "6:00 AM";
+		if ( !args.empty() )
+		{
+			std::ostringstream ss;
+			for ( std::size_t i = 0; i < args.size(); i++ )
+				ss << ( i > 0 ? " " : "" ) << args[ i ];
+			hour = ss.str();
+		}
+
+		bf::Time & t = bf::Time::singleton();
+		t.sleepUntil( time::Hour( hour ) );
+		c << setcinfo << "Woke up at " << t.getHour() << ", " << t.getDate() << con::endl;
+	}
+};
+
 class ShowFPS : public con::Command
 {
 	const std::string name() const
@@ -290,6 +394,7 @@ class Lua : public con::Command
 		{
 			executing = true;
 		
+			lua::Profiler::Scope scope( args[0], "console" );
 			if ( luaL_loadfile( lua, args[0].c_str() ) || lua_pcall( lua, 0, 0, 0 ) )
 			{
 				c << setcerr << lua_tostring( lua, -1 ) << con::endl;
@@ -309,6 +414,104 @@ public:
 	Lua() : executing( false ), lua( lua::state() ) {}
 };
 
+class LuaMemory : public con::Command
+{
+	mutable sf::Uint64 m_allocations;
+	mutable sf::Int64 m_time;
+
+	const std::string name() const
+	{
+		return "luamem";
+	}
+
+	unsigned minArgs() const
+	{
+		return 0;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Shows the memory used by lua, and the allocation rate since the last luamem" << con::endl;
+		c << setcinfo << "Usage: luamem" << con::endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		const lua::Allocator::Stats& stats = lua::Allocator::singleton().getStats();
+		sf::Int64 now = util::now( util::Real );
+
+		c << setcinfo << "Lua memory: " << stats.live / 1024 << " KB live, " << stats.peak / 1024 << " KB peak, " 
+			<< stats.slabs / 1024 << " KB in slabs" << con::endl;
+
+		std::ostringstream rate;
+		if ( now > m_time )
+			rate << ( stats.allocations - m_allocations ) * 1000000 / ( now - m_time ) << " per second";
+		else
+			rate << "n/a";
+		c << setcinfo << "Allocations: " << stats.allocations << " total, " << rate.str() << con::endl;
+
+		m_allocations = stats.allocations;
+		m_time = now;
+	}
+
+public:
+	LuaMemory() : m_allocations( lua::Allocator::singleton().getStats().allocations ), m_time( util::now( util::Real ) ) {}
+};
+
+class LuaProfile : public con::Command
+{
+	const std::string name() const
+	{
+		return "luaprof";
+	}
+
+	unsigned minArgs() const
+	{
+		return 1;
+	}
+
+	void help( Console& c ) const
+	{
+		c << setcinfo << "Profiles the calls into lua and samples the hottest lua stacks" << con::endl;
+		c << setcinfo << "Usage: luaprof start|stop|clear" << con::endl;
+		c << setcinfo << "Usage: luaprof dump [file] -- prints the timings, and writes folded stacks to file (default: luaprof.folded)" << con::endl;
+	}
+
+	void execute( Console& c, const std::vector< std::string >& args ) const
+	{
+		lua::Profiler& p = lua::Profiler::singleton();
+
+		if ( args[0] == "start" )
+		{
+			p.start();
+			c << setcinfo << "Lua profiler started" << con::endl;
+		}
+		else if ( args[0] == "stop" )
+		{
+			p.stop();
+			c << setcinfo << "Lua profiler stopped" << con::endl;
+		}
+		else if ( args[0] == "clear" )
+			p.clear();
+		else if ( args[0] == "dump" )
+		{
+			std::ostringstream ss;
+			p.report( ss );
+
+			std::istringstream lines( ss.str() );
+			for ( std::string line; std::getline( lines, line ); )
+				c << setcinfo << line << con::endl;
+
+			std::string file = args.size() >= 2 ? args[1] : "luaprof.folded";
+			if ( !p.writeStacks( file ) )
+				throw Exception( "Could not write to \"" + file + "\"" );
+			c << setcinfo << "Lua stacks written to " << file << con::endl;
+		}
+		else
+			throw Exception( "Unknown luaprof option \"" + args[0] + "\"" );
+	}
+};
+
 class ReloadMapObject : public con::Command
 {
 	const std::string name() const
@@ -397,11 +600,16 @@ void defaultCommands( Console & console )
 	console.addCommand( new Reposition );
 	console.addCommand( new Animate );
 	console.addCommand( new DebugCollision );
+	console.addCommand( new CacheMapLayers );
 	console.addCommand( new GetTime );
 	console.addCommand( new ShowFPS );
 	console.addCommand( new Timescale );
+	console.addCommand( new GameSpeed );
+	console.addCommand( new Sleep );
 	console.addCommand( new Message );
 	console.addCommand( new Lua );
+	console.addCommand( new LuaProfile );
+	console.addCommand( new LuaMemory );
 	console.addCommand( new ReloadMapObject );
 	console.addCommand( new Save );
 	console.addCommand( new Load );
@@ -2,8 +2,7 @@
 #include "mlpbf/database.h"
 #include "mlpbf/exception.h"
 #include "mlpbf/map.h"
-#include "mlpbf/graphics/animation.h"
-#include "mlpbf/graphics/spritesheet.h"
+#include "mlpbf/graphics/animation_set.h"
 #include "mlpbf/time/season.h"
 #include "mlpbf/xml.h"
 
@@ -187,6 +186,11 @@ public:
 	{ 
 		return *m_ids[ i ]; 
 	}
+	
+	unsigned size() const
+	{
+		return m_ids.size();
+	}
 } * g_dbMap = nullptr;
 
 /***************************************************************************/
@@ -214,21 +218,21 @@ class SpriteDatabase : public Database< std::string >
 	}
 	
 public:
-	void generate( const std::string & id, gfx::Spritesheet * sheet )
+	std::shared_ptr< const gfx::AnimationSet > getAnimations( const std::string & id )
 	{
-		// Animations
-		TiXmlDocument xml = xml::open( get( id ) );
-		const TiXmlElement& root = *xml.RootElement();
+		auto find = m_sets.find( id );
+		if ( find != m_sets.end() )
+			return find->second;
 
-		const TiXmlNode * it = nullptr;
-		while ( ( it = root.IterateChildren( "animation", it ) ) )
-		{
-			std::unique_ptr< gfx::Animation > anim( new gfx::Animation( static_cast< const TiXmlElement& >( *it ) ) );
-			std::string id = anim->getID();
+		TiXmlDocument xml = xml::open( get( id ) );
+		std::shared_ptr< const gfx::AnimationSet > set( new gfx::AnimationSet( *xml.RootElement() ) );
 
-			sheet->addAnimation( id, std::move( anim ) );
-		}
+		m_sets[ id ] = set;
+		return set;
 	}
+
+private:
+	std::unordered_map< std::string, std::shared_ptr< const gfx::AnimationSet > > m_sets;
 } * g_dbSprite = nullptr;
 
 /***************************************************************************/
@@ -268,9 +272,9 @@ const data::Item & db::getItem( const std::string & id )
 	return g_dbItem->get( id );
 }
 
-void db::genSprite( const std::string & id, gfx::Spritesheet * sheet )
+std::shared_ptr< const gfx::AnimationSet > db::getAnimations( const std::string & id )
 {
-	g_dbSprite->generate( id, sheet );
+	return g_dbSprite->getAnimations( id );
 }
 
 bf::Map & db::getMap( unsigned id )
@@ -283,6 +287,11 @@ bf::Map & db::getMap( const std::string & id )
 	return const_cast< bf::Map & >( g_dbMap->get( id ) );
 }
 
+unsigned db::getMapCount()
+{
+	return g_dbMap->size();
+}
+
 /***************************************************************************/
 
 } // namespace bf
@@ -2,6 +2,7 @@
 #include "mlpbf/farm.h"
 #include "mlpbf/global.h"
 #include "mlpbf/resource.h"
+#include "mlpbf/graphics/sprite_batch.h"
 
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Transformable.hpp>
@@ -50,6 +51,10 @@ public:
 	void draw( sf::RenderTarget & target, sf::RenderStates states ) const
 	{
 	}
+
+	void batch( gfx::SpriteBatch & batch, const sf::Transform & transform ) const
+	{
+	}
 	
 	bool hasCollision() const
 	{
@@ -69,7 +74,7 @@ public:
 
 /***************************************************************************/
 
-class Stone : public field::Object, res::TextureLoader<>
+class Stone : public field::Object, res::RegionLoader<>
 {
 	unsigned m_size;
 	
@@ -81,16 +86,21 @@ public:
 		
 		switch ( size )
 		{
-			case 1: loadTexture( "data/farm/clutter/rock_s.png" ); break;
-			case 2: loadTexture( "data/farm/clutter/rock_m.png" ); break;
-			case 3: loadTexture( "data/farm/clutter/rock_l.png" ); break;
+			case 1: loadRegion( "data/farm/clutter/rock_s.png" ); break;
+			case 2: loadRegion( "data/farm/clutter/rock_m.png" ); break;
+			case 3: loadRegion( "data/farm/clutter/rock_l.png" ); break;
 		}
 	}
 	
 	void draw( sf::RenderTarget & target, sf::RenderStates states ) const
 	{
 		states.transform *= getTransform();
-		target.draw( sf::Sprite( getTexture() ), states );
+		target.draw( sf::Sprite( *getRegion().texture, getRegion().rect ), states );
+	}
+
+	void batch( gfx::SpriteBatch & batch, const sf::Transform & transform ) const
+	{
+		batch.add( sf::Sprite( *getRegion().texture, getRegion().rect ), transform * getTransform() );
 	}
 	
 	bool hasCollision() const
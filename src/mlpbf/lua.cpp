@@ -4,30 +4,38 @@
 #include "mlpbf/farm.h"
 #include "mlpbf/global.h"
 #include "mlpbf/lua.h"
+#include "mlpbf/lua/allocator.h"
+#include "mlpbf/lua/profiler.h"
 #include "mlpbf/player.h"
 #include "mlpbf/resource.h"
 #include "mlpbf/time.h"
+#include "mlpbf/utility/timer.h"
 
 #include <algorithm>
 #include <cstring>
 #include <cstdio>
+#include <ctime>
 #include <deque>
 #include <iostream>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <SFML/Graphics/RenderTarget.hpp>
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Text.hpp>
-#include <SFML/Window/Keyboard.hpp>
 #include <SFML/System/Clock.hpp>
+#include <SFML/Window/Keyboard.hpp>
+
+#include <sys/stat.h>
 
 namespace bf
 {
 namespace lua
 {
 
-void addLuaRef( const std::string & str, int ref );
-void removeLuaRef( const std::string & str );
+void addHook( const std::string & id, int ref, int priority, unsigned interval, unsigned budget );
+void removeHook( const std::string & id );
 
 sf::Keyboard::Key getKeyFromString( const char * str );
 const char * getStringFromKey( sf::Keyboard::Key key );
@@ -92,22 +100,53 @@ static int game_fadeOut( lua_State * l )
 	return 0;
 }
 
-// game.hook( id, fn )
+// game.hook( id, fn, [options] )
+// fn( ms ) is called every frame with the milliseconds since its last call
+// options is a table of:
+//	priority	hooks with a lower priority run first (default 0)
+//	interval	minimum milliseconds between calls (default 0, every frame)
+//	budget		milliseconds a call may take before it is reported as slow (default 2)
 static int game_hook( lua_State * l )
 {
 	luaL_checktype( l, 1, LUA_TSTRING );
 	luaL_checktype( l, 2, LUA_TFUNCTION );
 	
+	int priority = 0;
+	unsigned interval = 0U, budget = 2U;
+	if ( !lua_isnoneornil( l, 3 ) )
+	{
+		luaL_checktype( l, 3, LUA_TTABLE );
+		
+		lua_getfield( l, 3, "priority" );
+		priority = luaL_optint( l, -1, priority );
+		lua_getfield( l, 3, "interval" );
+		interval = luaL_optunsigned( l, -1, interval );
+		lua_getfield( l, 3, "budget" );
+		budget = luaL_optunsigned( l, -1, budget );
+		lua_pop( l, 3 );
+	}
+	
 	lua_pushvalue( l, 2 );
-	addLuaRef( lua_tostring( l, 1 ), luaL_ref( l, LUA_REGISTRYINDEX ) );
+	int ref = luaL_ref( l, LUA_REGISTRYINDEX );
+	
+	try
+	{
+		addHook( lua_tostring( l, 1 ), ref, priority, interval, budget );
+	}
+	catch ( Exception & err )
+	{
+		luaL_unref( l, LUA_REGISTRYINDEX, ref );
+		return luaL_error( l, "%s", err.what() );
+	}
 	
 	return 0;
 }
 
 // game.unhook( id )
+// the hook stops running right away, even if called from inside a hook
 static int game_unhook( lua_State * l )
 {
-	removeLuaRef( luaL_checkstring( l, 1 ) );
+	removeHook( luaL_checkstring( l, 1 ) );
 	return 0;
 }
 
@@ -248,6 +287,7 @@ static int console_hook( lua_State * l )
 				numargs++;
 			}
 			
+			Profiler::Scope scope( cmd, "console" );
 			if ( lua_pcall( l, numargs, 0, 0 ) )
 			{
 				c << con::setcerr << lua_tostring( l, -1 ) << con::endl;
@@ -426,10 +466,140 @@ static int time_timescale( lua_State * l )
 	return 0;
 }
 
+static std::unordered_map< time::Scheduler::Handle, int > TimeRef;
+
+// Calls the lua function scheduled under a handle; one-shot timers drop their reference afterwards
+static void time_call( time::Scheduler::Handle h, bool once )
+{
+	lua_State * l = state();
+	
+	auto find = TimeRef.find( h );
+	if ( find == TimeRef.end() )
+		return;
+	lua_rawgeti( l, LUA_REGISTRYINDEX, find->second );
+	{
+		static const std::string TIME = "time";
+		Profiler::Scope scope( TIME, once ? "at" : "every" );
+		if ( lua_pcall( l, 0, 0, 0 ) )
+		{
+			Console::singleton() << con::setcerr << lua_tostring( l, -1 ) << con::endl;
+			lua_pop( l, 1 );
+		}
+	}
+
+	// The function may have cancelled its own timer, which already dropped the reference
+	if ( once && ( find = TimeRef.find( h ) ) != TimeRef.end() )
+	{
+		luaL_unref( l, LUA_REGISTRYINDEX, find->second );
+		TimeRef.erase( find );
+	}
+}
+
+// Returns the game minute of a time argument -- an hour string is its next occurrence, a number is minutes from now
+static unsigned time_check( lua_State * l, int arg )
+{
+	Time & time = Time::singleton();
+	if ( lua_type( l, arg ) == LUA_TSTRING )
+		return time.getMinutes( time::Hour( lua_tostring( l, arg ) ) );
+	return time.getMinutes() + luaL_checkunsigned( l, arg );
+}
+
+// time.at( hour|minutes, fn )
+// calls fn once at the next occurrence of an hour ("6:00 AM"), or in a number of game minutes
+// returns a handle for time.cancel
+static int time_at( lua_State * l )
+{
+	unsigned minute = time_check( l, 1 );
+	luaL_checktype( l, 2, LUA_TFUNCTION );
+	
+	lua_pushvalue( l, 2 );
+	int ref = luaL_ref( l, LUA_REGISTRYINDEX );
+	
+	// The handle is only known once scheduled, so the callback reads it through a shared slot
+	std::shared_ptr< time::Scheduler::Handle > slot( new time::Scheduler::Handle( 0 ) );
+	time::Scheduler::Handle h = *slot = Time::singleton().getScheduler().at( minute, [slot]() { time_call( *slot, true ); } );
+	TimeRef[ h ] = ref;
+	
+	lua_pushunsigned( l, h );
+	return 1;
+}
+
+// (1) time.every( hour, fn )
+// (2) time.every( minutes, fn )
+// calls fn every day at an hour ("6:00 AM"), or every number of game minutes
+// returns a handle for time.cancel
+static int time_every( lua_State * l )
+{
+	Time & time = Time::singleton();
+	
+	unsigned first, period;
+	if ( lua_type( l, 1 ) == LUA_TSTRING )
+	{
+		first = time_check( l, 1 );
+		period = Time::MINUTES_PER_DAY;
+	}
+	else
+	{
+		period = luaL_checkunsigned( l, 1 );
+		luaL_argcheck( l, period > 0, 1, "period must be greater than 0" );
+		first = time.getMinutes() + period;
+	}
+	luaL_checktype( l, 2, LUA_TFUNCTION );
+	
+	lua_pushvalue( l, 2 );
+	int ref = luaL_ref( l, LUA_REGISTRYINDEX );
+	
+	std::shared_ptr< time::Scheduler::Handle > slot( new time::Scheduler::Handle( 0 ) );
+	time::Scheduler::Handle h = *slot = time.getScheduler().every( first, period, [slot]() { time_call( *slot, false ); } );
+	TimeRef[ h ] = ref;
+	
+	lua_pushunsigned( l, h );
+	return 1;
+}
+
+// time.cancel( handle )
+// returns if the timer was still waiting
+static int time_cancel( lua_State * l )
+{
+	time::Scheduler::Handle h = luaL_checkunsigned( l, 1 );
+	bool cancelled = Time::singleton().getScheduler().cancel( h );
+	
+	auto find = TimeRef.find( h );
+	if ( find != TimeRef.end() )
+	{
+		luaL_unref( l, LUA_REGISTRYINDEX, find->second );
+		TimeRef.erase( find );
+	}
+	
+	lua_pushboolean( l, cancelled );
+	return 1;
+}
+
+// time.advance( minutes )
+// moves time forward in one jump, firing any timers that come due
+static int time_advance( lua_State * l )
+{
+	Time::singleton().advance( luaL_checkunsigned( l, 1 ) );
+	return 0;
+}
+
+// time.sleep( [hour] )
+// advances to the next occurrence of an hour (default: "6:00 AM")
+static int time_sleep( lua_State * l )
+{
+	Time::singleton().sleepUntil( time::Hour( luaL_optstring( l, 1, "6:00 AM" ) ) );
+	return 0;
+}
+
 static const struct luaL_Reg libtime[] =
 {
+	{ "advance",	time_advance },
+	{ "at",		time_at },
+	{ "cancel",	time_cancel },
 	{ "date", 	time_date },
+	{ "every",	time_every },
 	{ "hour",		time_hour },
+	{ "sleep",	time_sleep },
 	{ "state", 	time_state },
 	{ "timescale", time_timescale },
 	{ NULL, 		NULL },
@@ -441,33 +611,33 @@ static const char * TIMER_MT = "game.timer";
 
 static int timer_new( lua_State * l )
 {
-	sf::Clock * timer = (sf::Clock *) lua_newuserdata( l, sizeof( sf::Clock ) );
+	util::Timer * timer = (util::Timer *) lua_newuserdata( l, sizeof( util::Timer ) );
 	
 	luaL_getmetatable( l, TIMER_MT );
 	lua_setmetatable( l, -2 );
 	
-	new (timer) sf::Clock();
+	new (timer) util::Timer( true, util::Real );
 	
 	return 1;
 }
 
 static int timer_free( lua_State * l )
 {
-	sf::Clock * timer = (sf::Clock *) luaL_checkudata( l, 1, TIMER_MT );
-	timer->~Clock();
+	util::Timer * timer = (util::Timer *) luaL_checkudata( l, 1, TIMER_MT );
+	timer->~Timer();
 	return 0;
 }
 
 static int timer_getElapsedTime( lua_State * l )
 {
-	sf::Clock * timer = (sf::Clock *) luaL_checkudata( l, 1, TIMER_MT );
+	util::Timer * timer = (util::Timer *) luaL_checkudata( l, 1, TIMER_MT );
 	lua_pushinteger( l, timer->getElapsedTime().asMilliseconds() );
 	return 1;
 }
 
 static int timer_restart( lua_State * l )
 {
-	sf::Clock * timer = (sf::Clock *) luaL_checkudata( l, 1, TIMER_MT );
+	util::Timer * timer = (util::Timer *) luaL_checkudata( l, 1, TIMER_MT );
 	lua_pushinteger( l, timer->restart().asMilliseconds() );
 	return 1;
 }
@@ -1139,24 +1309,187 @@ static const struct luaL_Reg libfieldtile_mt [] =
 
 /***************************************************************************/
 
-static std::unordered_map< std::string, int > LuaRef;
+//-------------------------------------------------------------------------
+// Runs the game.hook functions each frame, in order of priority then of hooking
+//
+// Hooks live in a vector that is never resized while they run: hooks added during
+// an update wait in m_pending and removed ones are only marked, until the update ends
+//-------------------------------------------------------------------------
+class HookScheduler
+{
+	struct Hook
+	{
+		std::string id;
+		int ref;
+		int priority;
+		unsigned interval;	// ms; 0 runs every frame
+		unsigned elapsed;	// ms since the hook last ran
+		sf::Int64 budget;	// us
+		bool removed;
+		bool slow;			// Has gone over budget, and was reported
+	};
+
+public:
+	HookScheduler() : m_running( false ) {}
+
+	void add( const std::string & id, int ref, int priority, unsigned interval, unsigned budget )
+	{
+		if ( find( m_hooks, id ) || find( m_pending, id ) )
+			throw Exception( "reference ID already exists" );
+
+		Hook hook = { id, ref, priority, interval, 0U, sf::milliseconds( budget ).asMicroseconds(), false, false };
+		m_pending.push_back( hook );
+
+		if ( !m_running )
+			apply();
+	}
+
+	void remove( const std::string & id )
+	{
+		Hook * hook = find( m_hooks, id );
+		if ( !hook )
+			hook = find( m_pending, id );
+		if ( !hook )
+			return;
+
+		hook->removed = true;
+		if ( !m_running )
+			apply();
+	}
+
+	void update( unsigned ms )
+	{
+		lua_State * l = state();
+		m_running = true;
+
+		for ( Hook & hook : m_hooks )
+		{
+			if ( hook.removed )
+				continue;
+
+			hook.elapsed += ms;
+			if ( hook.elapsed < hook.interval )
+				continue;
+
+			unsigned elapsed = hook.elapsed;
+			hook.elapsed = 0U;
+
+			sf::Clock clock;
+			lua_rawgeti( l, LUA_REGISTRYINDEX, hook.ref );
+			lua_pushinteger( l, elapsed );
+
+			Profiler::Scope scope( hook.id, "hook" );
+			if ( lua_pcall( l, 1, 0, 0 ) )
+			{
+				Console::singleton() << con::setcerr << lua_tostring( l, -1 ) << con::endl;
+				Console::singleton() << con::setcerr << "Unhooking lua function " << hook.id << con::endl;
+				lua_pop( l, 1 );
+				hook.removed = true;
+				continue;
+			}
+
+			sf::Int64 time = clock.getElapsedTime().asMicroseconds();
+			if ( time > hook.budget && !hook.slow )
+			{
+				Console::singleton() << con::setcerr << "Lua hook " << hook.id << " took " << time / 1000.0f << "ms, over its budget of " 
+					<< hook.budget / 1000.0f << "ms" << con::endl;
+				hook.slow = true;
+			}
+		}
+
+		m_running = false;
+		apply();
+	}
 
-void addLuaRef( const std::string & str, int ref )
+	void clear()
+	{
+		for ( Hook & hook : m_hooks )
+			luaL_unref( state(), LUA_REGISTRYINDEX, hook.ref );
+		for ( Hook & hook : m_pending )
+			luaL_unref( state(), LUA_REGISTRYINDEX, hook.ref );
+		m_hooks.clear();
+		m_pending.clear();
+	}
+
+private:
+	static Hook * find( std::vector< Hook > & hooks, const std::string & id )
+	{
+		for ( Hook & hook : hooks )
+			if ( !hook.removed && hook.id == id )
+				return &hook;
+		return nullptr;
+	}
+
+	// Drops removed hooks and places pending ones after any of equal priority
+	void apply()
+	{
+		auto removed = [&]( const Hook & hook ) -> bool
+		{
+			if ( hook.removed )
+				luaL_unref( state(), LUA_REGISTRYINDEX, hook.ref );
+			return hook.removed;
+		};
+		m_hooks.erase( std::remove_if( m_hooks.begin(), m_hooks.end(), removed ), m_hooks.end() );
+		m_pending.erase( std::remove_if( m_pending.begin(), m_pending.end(), removed ), m_pending.end() );
+
+		for ( const Hook & hook : m_pending )
+		{
+			auto at = std::upper_bound( m_hooks.begin(), m_hooks.end(), hook, []( const Hook & a, const Hook & b ) { return a.priority < b.priority; } );
+			m_hooks.insert( at, hook );
+		}
+		m_pending.clear();
+	}
+
+private:
+	std::vector< Hook > m_hooks, m_pending;
+	bool m_running;
+};
+
+static HookScheduler Hooks;
+
+void addHook( const std::string & id, int ref, int priority, unsigned interval, unsigned budget )
 {
-	if ( LuaRef.find( str ) != LuaRef.end() )
-		throw Exception( "reference ID already exists" );
-	LuaRef.insert( std::make_pair( str, ref ) );
+	Hooks.add( id, ref, priority, interval, budget );
 }
 
-void removeLuaRef( const std::string & str )
+void removeHook( const std::string & id )
 {
-	LuaRef.erase( str );
+	Hooks.remove( id );
 }
 
 /***************************************************************************/
 
 static lua_State * LUA = nullptr;
 
+// Compiled chunks by path, with the modification time of the file they were compiled from
+static std::unordered_map< std::string, std::pair< std::time_t, int > > ChunkCache;
+
+int loadFile( const std::string & file )
+{
+	// Let lua report files that can't be read
+	struct stat info;
+	if ( stat( file.c_str(), &info ) != 0 )
+		return luaL_loadfile( LUA, file.c_str() );
+
+	auto find = ChunkCache.find( file );
+	if ( find != ChunkCache.end() && find->second.first == info.st_mtime )
+	{
+		lua_rawgeti( LUA, LUA_REGISTRYINDEX, find->second.second );
+		return LUA_OK;
+	}
+
+	int status = luaL_loadfile( LUA, file.c_str() );
+	if ( status != LUA_OK )
+		return status;
+
+	if ( find != ChunkCache.end() )
+		luaL_unref( LUA, LUA_REGISTRYINDEX, find->second.second );
+
+	lua_pushvalue( LUA, -1 );
+	ChunkCache[ file ] = std::make_pair( info.st_mtime, luaL_ref( LUA, LUA_REGISTRYINDEX ) );
+	return LUA_OK;
+}
+
 inline void register_metatable( lua_State * l, const char * name, const struct luaL_Reg lib[] )
 {
 	luaL_newmetatable( l, name );
@@ -1168,13 +1501,23 @@ inline void register_metatable( lua_State * l, const char * name, const struct l
 	lua_pop( l, 1 );
 }
 
+// Reports an error raised outside of any protected call, as luaL_newstate's panic function does
+static int panic( lua_State * l )
+{
+	std::cerr << "PANIC: unprotected error in call to Lua API (" << lua_tostring( l, -1 ) << ")" << std::endl;
+	return 0;
+}
+
 // Macro because inline function throws a warning
 #define register_library(L,n,l) (luaL_newlib(L,l),lua_setglobal(L,n))
 
 void init()
 {
-	// create lua state
-	lua_State * l = LUA = luaL_newstate();
+	// create lua state, with the pooled allocator
+	lua_State * l = LUA = lua_newstate( &Allocator::alloc, &Allocator::singleton() );
+	if ( !l )
+		throw Exception( "Failed to create the lua state" );
+	lua_atpanic( l, panic );
 	luaL_openlibs( l );
 	
 	// register metatables
@@ -1206,11 +1549,23 @@ void init()
 
 void cleanup()
 {
-	for ( auto i : LuaRef )
+	Hooks.clear();
+	
+	for ( auto i : ChunkCache )
+		luaL_unref( LUA, LUA_REGISTRYINDEX, i.second.second );
+	ChunkCache.clear();
+	
+	for ( auto i : TimeRef )
+	{
+		Time::singleton().getScheduler().cancel( i.first );
 		luaL_unref( LUA, LUA_REGISTRYINDEX, i.second );
-	LuaRef.clear();
+	}
+	TimeRef.clear();
 	
 	lua_close( LUA );
+	LUA = nullptr;
+	
+	Allocator::singleton().release();
 }
 
 lua_State * state()
@@ -1218,29 +1573,13 @@ lua_State * state()
 	return LUA;
 }
 
-void update( unsigned ms )
+void update( const sf::Time& time )
 {
-	for ( auto ref : LuaRef )
-	{
-		try
-		{
-			lua_rawgeti( LUA, LUA_REGISTRYINDEX, ref.second );
-			lua_pushinteger( LUA, ms );
-			
-			if ( lua_pcall( LUA, 1, 0, 0 ) )
-			{
-				std::string err = lua_tostring( LUA, -1 );
-				lua_pop( LUA, 1 );
-				throw Exception( err );
-			}
-		}
-		catch ( Exception & err )
-		{
-			Console::singleton() << con::setcerr << err.what() << con::endl;
-			Console::singleton() << con::setcerr << "Unhooking lua function " << ref.first << con::endl;
-			removeLuaRef( ref.first );
-		}
-	}
+	static sf::Int64 remainder = 0; // Microseconds short of a whole millisecond
+	
+	sf::Int64 us = time.asMicroseconds() + remainder;
+	remainder = us % 1000;
+	Hooks.update( (unsigned) ( us / 1000 ) );
 }
 
 /***************************************************************************/
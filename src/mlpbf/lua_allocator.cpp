@@ -0,0 +1,165 @@
+#include "mlpbf/lua/allocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace bf
+{
+namespace lua
+{
+
+/***************************************************************************/
+
+Allocator& Allocator::singleton()
+{
+	static Allocator a;
+	return a;
+}
+
+Allocator::Allocator()
+{
+	m_free.fill( nullptr );
+	m_stats.live = m_stats.peak = m_stats.slabs = 0U;
+	m_stats.allocations = 0U;
+}
+
+Allocator::~Allocator()
+{
+	release();
+}
+
+void Allocator::release()
+{
+	for ( char* slab : m_slabs )
+		std::free( slab );
+	m_slabs.clear();
+	m_free.fill( nullptr );
+	m_stats.slabs = 0U;
+}
+
+/***************************************************************************/
+
+void* Allocator::alloc( void* ud, void* ptr, std::size_t osize, std::size_t nsize )
+{
+	Allocator& a = *static_cast< Allocator* >( ud );
+
+	// osize is only a size when there is a block; otherwise it says what Lua is allocating
+	if ( !ptr )
+		osize = 0U;
+
+	if ( nsize == 0U )
+	{
+		if ( ptr )
+			a.deallocate( ptr, osize );
+		return nullptr;
+	}
+
+	// Blocks that stay in the same size class (or both stay with malloc) can be reused or resized in place
+	if ( ptr )
+	{
+		if ( osize <= MAX_SMALL && nsize <= MAX_SMALL && sizeClass( osize ) == sizeClass( nsize ) )
+		{
+			a.m_stats.live = a.m_stats.live - osize + nsize;
+			a.m_stats.peak = std::max( a.m_stats.peak, a.m_stats.live );
+			return ptr;
+		}
+
+		if ( osize > MAX_SMALL && nsize > MAX_SMALL )
+		{
+			void* block = std::realloc( ptr, nsize );
+			if ( block )
+			{
+				a.m_stats.live = a.m_stats.live - osize + nsize;
+				a.m_stats.peak = std::max( a.m_stats.peak, a.m_stats.live );
+			}
+			return block ? block : a.keep( ptr, osize, nsize );
+		}
+	}
+
+	void* block = a.allocate( nsize );
+	if ( !block )
+		return ptr ? a.keep( ptr, osize, nsize ) : nullptr;
+
+	if ( ptr )
+	{
+		std::memcpy( block, ptr, std::min( osize, nsize ) );
+		a.deallocate( ptr, osize );
+	}
+	return block;
+}
+
+void* Allocator::keep( void* ptr, std::size_t osize, std::size_t nsize )
+{
+	// Lua requires shrinking to never fail, so a shrink with no room to move keeps the old block
+	// Lua frees it as nsize later, which is safe: the block is at least as big as nsize's class
+	// (a malloc'd block then ends up on a free list instead of going back to malloc)
+	if ( nsize > osize )
+		return nullptr;
+
+	m_stats.live = m_stats.live - osize + nsize;
+	return ptr;
+}
+
+void* Allocator::allocate( std::size_t size )
+{
+	void* block;
+
+	if ( size > MAX_SMALL )
+		block = std::malloc( size );
+	else
+	{
+		const std::size_t c = sizeClass( size );
+
+		if ( !m_free[ c ] )
+		{
+			// Carve a new slab into blocks of this class
+			char* slab = (char*) std::malloc( SLAB_SIZE );
+			if ( !slab )
+				return nullptr;
+			m_slabs.push_back( slab );
+			m_stats.slabs += SLAB_SIZE;
+
+			const std::size_t blockSize = ( c + 1 ) * GRANULARITY;
+			for ( std::size_t offset = 0; offset + blockSize <= SLAB_SIZE; offset += blockSize )
+			{
+				Block* b = reinterpret_cast< Block* >( slab + offset );
+				b->next = m_free[ c ];
+				m_free[ c ] = b;
+			}
+		}
+
+		Block* b = m_free[ c ];
+		m_free[ c ] = b->next;
+		block = b;
+	}
+
+	if ( block )
+	{
+		m_stats.live += size;
+		m_stats.peak = std::max( m_stats.peak, m_stats.live );
+		m_stats.allocations++;
+	}
+	return block;
+}
+
+void Allocator::deallocate( void* ptr, std::size_t size )
+{
+	m_stats.live -= size;
+
+	if ( size > MAX_SMALL )
+		std::free( ptr );
+	else
+	{
+		Block* b = static_cast< Block* >( ptr );
+		const std::size_t c = sizeClass( size );
+		b->next = m_free[ c ];
+		m_free[ c ] = b;
+	}
+}
+
+/***************************************************************************/
+
+} // namespace lua
+
+} // namespace bf
@@ -0,0 +1,139 @@
+#include "mlpbf/lua/profiler.h"
+#include "mlpbf/lua.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace bf
+{
+namespace lua
+{
+
+/***************************************************************************/
+
+Profiler& Profiler::singleton()
+{
+	static Profiler p;
+	return p;
+}
+
+void Profiler::start()
+{
+	if ( m_running )
+		return;
+
+	m_running = true;
+	lua_sethook( state(), &Profiler::sample, LUA_MASKCOUNT, SAMPLE_INTERVAL );
+}
+
+void Profiler::stop()
+{
+	if ( !m_running )
+		return;
+
+	m_running = false;
+	lua_sethook( state(), nullptr, 0, 0 );
+}
+
+void Profiler::clear()
+{
+	m_entries.clear();
+	m_stacks.clear();
+}
+
+/***************************************************************************/
+
+Profiler::Scope::Scope( const std::string& object, const char* callback ) :
+	m_timing( Profiler::singleton().m_running ),
+	m_start( 0 )
+{
+	if ( m_timing )
+	{
+		Profiler& p = Profiler::singleton();
+		p.m_scopes.push_back( std::make_pair( object, std::string( callback ) ) );
+		m_start = p.now();
+	}
+}
+
+Profiler::Scope::~Scope()
+{
+	if ( !m_timing )
+		return;
+
+	Profiler& p = Profiler::singleton();
+	sf::Int64 time = p.now() - m_start;
+
+	Entry& e = p.m_entries[ p.m_scopes.back() ];
+	e.calls++;
+	e.total += time;
+	e.max = std::max( e.max, time );
+
+	p.m_scopes.pop_back();
+}
+
+/***************************************************************************/
+
+void Profiler::sample( lua_State* l, lua_Debug* )
+{
+	Profiler& p = Profiler::singleton();
+
+	// Walk from the innermost function out, then fold root first
+	std::vector< std::string > frames;
+	lua_Debug ar;
+	for ( int level = 0; lua_getstack( l, level, &ar ); level++ )
+	{
+		lua_getinfo( l, "Sn", &ar );
+
+		std::ostringstream frame;
+		frame << ( ar.name ? ar.name : "?" );
+		if ( ar.what && std::string( ar.what ) != "C" )
+			frame << " (" << ar.short_src << ":" << ar.linedefined << ")";
+		frames.push_back( frame.str() );
+	}
+
+	std::ostringstream stack;
+	for ( const auto& scope : p.m_scopes )
+		stack << scope.first << ":" << scope.second << ";";
+	for ( auto it = frames.rbegin(); it != frames.rend(); ++it )
+		stack << ( it == frames.rbegin() ? "" : ";" ) << *it;
+
+	p.m_stacks[ stack.str() ]++;
+}
+
+/***************************************************************************/
+
+void Profiler::report( std::ostream& out ) const
+{
+	typedef std::pair< Key, Entry > Row;
+	std::vector< Row > sorted( m_entries.begin(), m_entries.end() );
+	std::sort( sorted.begin(), sorted.end(), []( const Row& a, const Row& b ) { return a.second.total > b.second.total; } );
+
+	out << std::fixed << std::setprecision( 3 );
+	for ( const Row& row : sorted )
+	{
+		const Entry& e = row.second;
+		out << row.first.first << ":" << row.first.second << "  calls " << e.calls 
+			<< "  total " << e.total / 1000.0 << "ms"
+			<< "  avg " << e.total / 1000.0 / e.calls << "ms"
+			<< "  max " << e.max / 1000.0 << "ms" << std::endl;
+	}
+}
+
+bool Profiler::writeStacks( const std::string& file ) const
+{
+	std::ofstream out( file.c_str() );
+	if ( !out )
+		return false;
+
+	for ( const auto& s : m_stacks )
+		out << s.first << " " << s.second << "\n";
+	return true;
+}
+
+/***************************************************************************/
+
+} // namespace lua
+
+} // namespace bf
@@ -17,10 +17,13 @@
 
 #include "mlpbf/console.h"
 #include "mlpbf/console/function.h"
+#include "mlpbf/graphics/animator.h"
 #include "mlpbf/lua.h"
+#include "mlpbf/utility/timer.h"
 
 #include <SFML/System/Clock.hpp>
 #include <SFML/Graphics.hpp>
+#include <algorithm>
 #include <deque>
 
 // NOTE:
@@ -28,6 +31,7 @@
 
 bool bf::DEBUG_COLLISION = false;
 bool bf::SHOW_FPS = true;
+bool bf::CACHE_MAP_LAYERS = false;
 
 #ifdef MAIN_TRY_CATCH
 #	ifdef _WIN32
@@ -37,6 +41,12 @@ bool bf::SHOW_FPS = true;
 #	endif
 #endif
 
+// The simulation runs at 120 Hz regardless of the frame rate
+static const sf::Time SIMULATION_STEP = sf::microseconds( 1000000 / 120 );
+
+// Steps run per frame at most; a longer stall slows the game down instead of spiralling
+static const unsigned MAX_SIMULATION_STEPS = 8U;
+
 /***************************************************************************/
 
 class FPS : public sf::Drawable, bf::res::FontLoader<>
@@ -75,14 +85,14 @@ public:
 
 private:
 	unsigned int m_frames, m_fps;
-	sf::Clock m_clock;
+	bf::util::Timer m_clock = bf::util::Timer( true, bf::util::Real );
 } FPS;
 
 /***************************************************************************/
 
 class Fade : public sf::Drawable
 {
-	sf::Clock m_timer;
+	bf::util::Timer m_timer = bf::util::Timer( true, bf::util::UI );
 	sf::Time m_target;
 	
 	sf::Color m_color;
@@ -218,6 +228,7 @@ int main( int argc, char* argv[] )
 		state::global( std::unique_ptr< state::Base >( new state::Map() ) );
 
 		sf::Clock clock;
+		sf::Time accumulator;
 		Console& console = Console::singleton();
 
 		Player::singleton().setMap( "path_a", sf::Vector2f( 448.0f , 448.0f ) );
@@ -234,10 +245,33 @@ int main( int argc, char* argv[] )
 				state.handleEvents( ev );
 			}
 
+			// Read the system clock once per frame; every util::Timer counts from these ticks
 			sf::Time time = clock.restart();
-			state.update( time );
+			bf::util::advance( bf::util::Real, time );
+			bf::util::advance( bf::util::UI, time );
+
+			// Run the simulation in fixed steps, dropping time the loop can't catch up on
+			accumulator += time;
+
+			unsigned steps = 0U;
+			for ( ; accumulator >= SIMULATION_STEP && steps < MAX_SIMULATION_STEPS; steps++ )
+			{
+				// The world moves by however much game time the step was worth; nothing while paused
+				sf::Int64 before = bf::util::now( bf::util::Game );
+				bf::util::advance( bf::util::Game, SIMULATION_STEP );
+				sf::Time step = sf::microseconds( bf::util::now( bf::util::Game ) - before );
+
+				bf::gfx::Animator::singleton().update();
+				state.update( step );
+				accumulator -= SIMULATION_STEP;
+			}
+			if ( steps == MAX_SIMULATION_STEPS )
+				accumulator = std::min( accumulator, SIMULATION_STEP );
+
+			state.interpolate( (float) accumulator.asMicroseconds() / SIMULATION_STEP.asMicroseconds() );
+
 			if ( !Console::singleton().state() ) 
-				lua::update( time.asMilliseconds() );
+				lua::update( time );
 			FPS.update();
 			ScreenTint.update();
 
@@ -5,12 +5,16 @@
 #include "mlpbf/exception.h"
 #include "mlpbf/farm.h"
 #include "mlpbf/global.h"
+#include "mlpbf/graphics/sprite_batch.h"
 #include "mlpbf/lua.h"
+#include "mlpbf/lua/profiler.h"
 #include "mlpbf/map.h"
 #include "mlpbf/resource.h"
+#include "mlpbf/time.h"
 #include "mlpbf/time/season.h"
 
 #include <algorithm>
+#include <limits>
 #include <SFML/Graphics/RectangleShape.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
 #include <sstream>
@@ -43,6 +47,140 @@ inline void renderLayer( sf::RenderTarget& target, sf::RenderStates& states,
 			}
 }
 
+inline void renderChunks( sf::RenderTarget& target, sf::RenderStates states, 
+						  const Map& map, const std::vector< Map::Chunk >& chunks, const sf::FloatRect& rect )
+{
+	if ( chunks.empty() ) return;
+
+	const int chunkWidth = Map::CHUNK_SIZE * TILE_WIDTH;
+	const int chunkHeight = Map::CHUNK_SIZE * TILE_HEIGHT;
+
+	// Only visit the chunks that intersect the view
+	int left	= std::max( 0, static_cast< int >( std::floor( rect.left / chunkWidth ) ) );
+	int top		= std::max( 0, static_cast< int >( std::floor( rect.top / chunkHeight ) ) );
+	int right	= std::min( (int) map.getChunkColumns() - 1, static_cast< int >( std::floor( ( rect.left + rect.width ) / chunkWidth ) ) );
+	int bottom	= std::min( (int) map.getChunkRows() - 1, static_cast< int >( std::floor( ( rect.top + rect.height ) / chunkHeight ) ) );
+
+	states.transform.translate( -rect.left, -rect.top );
+
+	for ( int y = top; y <= bottom; y++ )
+		for ( int x = left; x <= right; x++ )
+		{
+			const Map::Chunk& chunk = chunks[ y * map.getChunkColumns() + x ];
+			if ( chunk.batches.empty() ) continue;
+
+			if ( CACHE_MAP_LAYERS )
+			{
+				if ( !chunk.cache )
+				{
+					chunk.cache.reset( new sf::RenderTexture() );
+					if ( !chunk.cache->create( (unsigned) chunk.bounds.width, (unsigned) chunk.bounds.height ) )
+						throw Exception( "Failed to create a map layer cache" );
+					chunk.dirty = true;
+				}
+
+				// Composite the chunk's layer stack once
+				if ( chunk.dirty )
+				{
+					sf::RenderStates cacheStates;
+					cacheStates.transform.translate( -chunk.bounds.left, -chunk.bounds.top );
+
+					chunk.cache->clear( sf::Color::Transparent );
+					for ( auto it = chunk.batches.begin(); it != chunk.batches.end(); ++it )
+					{
+						cacheStates.texture = it->first;
+						chunk.cache->draw( it->second, cacheStates );
+					}
+					chunk.cache->display();
+					chunk.dirty = false;
+				}
+
+				sf::Sprite sprite( chunk.cache->getTexture() );
+				sprite.setPosition( chunk.bounds.left, chunk.bounds.top );
+				target.draw( sprite, states );
+			}
+			else
+			{
+				for ( auto it = chunk.batches.begin(); it != chunk.batches.end(); ++it )
+				{
+					states.texture = it->first;
+					target.draw( it->second, states );
+				}
+			}
+		}
+}
+
+inline bool sameVertices( const sf::VertexArray& a, const sf::VertexArray& b )
+{
+	if ( a.getVertexCount() != b.getVertexCount() )
+		return false;
+
+	for ( std::size_t i = 0; i < a.getVertexCount(); i++ )
+		if ( a[ i ].position != b[ i ].position || a[ i ].texCoords != b[ i ].texCoords )
+			return false;
+	return true;
+}
+
+inline void appendTile( sf::VertexArray& array, const sf::Vector2u& pos, const sf::IntRect& rect )
+{
+	float x = (float) pos.x * TILE_WIDTH;
+	float y = (float) pos.y * TILE_HEIGHT;
+
+	float u = (float) rect.left;
+	float v = (float) rect.top;
+
+	array.append( sf::Vertex( sf::Vector2f( x, y ), sf::Vector2f( u, v ) ) );
+	array.append( sf::Vertex( sf::Vector2f( x + TILE_WIDTH, y ), sf::Vector2f( u + rect.width, v ) ) );
+	array.append( sf::Vertex( sf::Vector2f( x + TILE_WIDTH, y + TILE_HEIGHT ), sf::Vector2f( u + rect.width, v + rect.height ) ) );
+	array.append( sf::Vertex( sf::Vector2f( x, y + TILE_HEIGHT ), sf::Vector2f( u, v + rect.height ) ) );
+}
+
+// Swept AABB test of box moving along delta against a static obstacle
+// Boxes that already overlap the obstacle are let through, so nothing gets stuck inside a wall
+inline bool sweepBox( const sf::FloatRect& box, const sf::Vector2f& delta, const sf::FloatRect& obstacle, Map::Contact& contact )
+{
+	const float inf = std::numeric_limits< float >::infinity();
+	float entryX = -inf, exitX = inf, entryY = -inf, exitY = inf;
+
+	if ( delta.x > 0.0f )
+	{
+		entryX = ( obstacle.left - ( box.left + box.width ) ) / delta.x;
+		exitX = ( obstacle.left + obstacle.width - box.left ) / delta.x;
+	}
+	else if ( delta.x < 0.0f )
+	{
+		entryX = ( obstacle.left + obstacle.width - box.left ) / delta.x;
+		exitX = ( obstacle.left - ( box.left + box.width ) ) / delta.x;
+	}
+	else if ( box.left + box.width <= obstacle.left || obstacle.left + obstacle.width <= box.left )
+		return false;
+
+	if ( delta.y > 0.0f )
+	{
+		entryY = ( obstacle.top - ( box.top + box.height ) ) / delta.y;
+		exitY = ( obstacle.top + obstacle.height - box.top ) / delta.y;
+	}
+	else if ( delta.y < 0.0f )
+	{
+		entryY = ( obstacle.top + obstacle.height - box.top ) / delta.y;
+		exitY = ( obstacle.top - ( box.top + box.height ) ) / delta.y;
+	}
+	else if ( box.top + box.height <= obstacle.top || obstacle.top + obstacle.height <= box.top )
+		return false;
+
+	float entry = std::max( entryX, entryY );
+	float exit = std::min( exitX, exitY );
+	if ( entry > exit || entry < 0.0f || contact.time <= entry )
+		return false;
+
+	contact.time = entry;
+	if ( entryX > entryY )
+		contact.normal = sf::Vector2f( delta.x > 0.0f ? -1.0f : 1.0f, 0.0f );
+	else
+		contact.normal = sf::Vector2f( 0.0f, delta.y > 0.0f ? -1.0f : 1.0f );
+	return true;
+}
+
 inline float round( float f )
 {
 	if ( f - std::floor( f ) >= 0.5f )
@@ -74,12 +212,13 @@ inline void setNeighbor( const std::map< std::string, std::string >& map, const
 class Map::Object : public virtual sf::Drawable, private virtual sf::Transformable
 {
 public:
-	friend Map::Object * generateObject( const Tmx::Object & );
+	friend Map::Object * generateObject( const Tmx::Object &, Map & );
 	virtual ~Object() {}
 
 	inline const std::string & getName() const { return m_name; }
 	inline const sf::FloatRect & getBounds() const { return m_bounds; }
 	inline const Tmx::Object & getObject() const { return *m_object; }
+	inline Map & getMap() const { return *m_map; }
 
 	using sf::Transformable::getPosition;
 	using sf::Transformable::setPosition;
@@ -96,6 +235,25 @@ public:
 
 	virtual bool hasCollision( const sf::Vector2f& pos ) const = 0;
 
+	// Bits of getCallbacks()
+	enum Callback
+	{
+		OnUpdate		= 1 << 0,
+		OnEnter			= 1 << 1,
+		WhileInside		= 1 << 2,
+		OnExit			= 1 << 3,
+		OnInteract		= 1 << 4,
+		HasCollision	= 1 << 5,
+	};
+
+	// Returns which of the callbacks above do something, so the map can skip calling the rest
+	// Read once when the object is loaded
+	virtual unsigned getCallbacks() const { return ~0U; }
+
+	// Adds the object's sprites to batch instead of drawing them
+	// Objects that return false are drawn directly, under everything batched
+	virtual bool batch( gfx::SpriteBatch& batch, const sf::Transform& transform ) const { return false; }
+
 protected:
 	using sf::Transformable::getTransform;
 
@@ -103,9 +261,10 @@ private:
 	std::string m_name;
 	sf::FloatRect m_bounds;
 	const Tmx::Object * m_object;
+	Map * m_map;
 };
 
-Map::Object * generateObject( const Tmx::Object & tmxObject );
+Map::Object * generateObject( const Tmx::Object & tmxObject, Map & map );
 
 /***************************************************************************/
 
@@ -141,87 +300,201 @@ bool Map::adjustSprite( const Tmx::Layer& layer, sf::Vector2u pos, sf::Sprite& s
 {
 	assertBounds( pos, getWidth(), getHeight() );
 
-	const Tmx::MapTile& tile = layer.GetTile( pos.x, pos.y );
-	if ( tile.tileset == nullptr ) return false;
-
-	const Tmx::Tileset& tileset = *tile.tileset;
-
-	const std::shared_ptr< sf::Texture >& texture = m_textures.find( &tileset )->second;
-	unsigned tilesetWidth = texture->getSize().x / TILE_WIDTH;
-	
-	sf::IntRect rect;
-	rect.left	= tile.id % tilesetWidth * TILE_WIDTH;
-	rect.top	= tile.id / tilesetWidth * TILE_HEIGHT;
-	rect.width	= TILE_WIDTH;
-	rect.height = TILE_HEIGHT;
+	const TileFrame& frame = getTileFrame( layer.GetTile( pos.x, pos.y ) );
+	if ( frame.texture == nullptr ) return false;
 
 	sprite.setPosition( (float) pos.x * TILE_WIDTH, (float) pos.y * TILE_HEIGHT );
-	sprite.setTexture( *texture );
-	sprite.setTextureRect( rect );
+	sprite.setTexture( *frame.texture );
+	sprite.setTextureRect( frame.rect );
 
 	return true;
 }
 
-bool Map::checkTileCollision( const sf::Vector2u& pos ) const
+bool Map::buildChunk( const std::vector< const Tmx::Layer* >& layers, unsigned cx, unsigned cy, Chunk& chunk ) const
 {
-	return m_collision && ( 0 <= pos.x && pos.x < getWidth() && 0 <= pos.y && pos.y < getHeight() ) && m_collision->GetTile( pos.x, pos.y ).tileset != 0;
+	std::vector< std::pair< const sf::Texture*, sf::VertexArray > > batches;
+
+	const unsigned endX = std::min( ( cx + 1 ) * CHUNK_SIZE, getWidth() );
+	const unsigned endY = std::min( ( cy + 1 ) * CHUNK_SIZE, getHeight() );
+
+	for ( auto it = layers.begin(); it != layers.end(); ++it )
+	{
+		// Batches of earlier layers must be drawn first, so only merge within this layer
+		const std::size_t first = batches.size();
+
+		for ( unsigned y = cy * CHUNK_SIZE; y < endY; y++ )
+			for ( unsigned x = cx * CHUNK_SIZE; x < endX; x++ )
+			{
+				const TileFrame& frame = getTileFrame( (*it)->GetTile( x, y ) );
+				if ( frame.texture == nullptr ) continue;
+
+				std::size_t i = first;
+				while ( i < batches.size() && batches[ i ].first != frame.texture )
+					i++;
+				if ( i == batches.size() )
+					batches.push_back( std::make_pair( frame.texture, sf::VertexArray( sf::Quads ) ) );
+
+				appendTile( batches[ i ].second, sf::Vector2u( x, y ), frame.rect );
+			}
+	}
+
+	chunk.bounds = sf::FloatRect( (float) cx * CHUNK_SIZE * TILE_WIDTH, (float) cy * CHUNK_SIZE * TILE_HEIGHT, 
+								  (float) CHUNK_SIZE * TILE_WIDTH, (float) CHUNK_SIZE * TILE_HEIGHT );
+
+	// Leave the cache alone if nothing in the chunk changed
+	bool changed = batches.size() != chunk.batches.size();
+	for ( std::size_t i = 0; !changed && i < batches.size(); i++ )
+		changed = batches[ i ].first != chunk.batches[ i ].first || !sameVertices( batches[ i ].second, chunk.batches[ i ].second );
+
+	if ( changed )
+	{
+		chunk.batches.swap( batches );
+		chunk.dirty = true;
+	}
+	return changed;
 }
 
-bool Map::checkObjectCollision( const sf::Vector2f& pos ) const
+void Map::buildChunks( const std::vector< const Tmx::Layer* >& layers, std::vector< Chunk >& chunks ) const
 {
-	if ( !m_collision ) 
-		return false;
+	const unsigned columns = getChunkColumns(), rows = getChunkRows();
 
-	for ( Map::Object * obj : m_objects )
-		if ( obj->getBounds().contains( pos ) && obj->hasCollision( pos - obj->getPosition() ) )
-			return true;
-	return false;
+	if ( chunks.size() != columns * rows )
+	{
+		chunks.clear();
+		chunks.resize( columns * rows );
+	}
+
+	for ( unsigned cy = 0; cy < rows; cy++ )
+		for ( unsigned cx = 0; cx < columns; cx++ )
+			buildChunk( layers, cx, cy, chunks[ cy * columns + cx ] );
 }
 
-void Map::load( unsigned id, const std::string& map )
+void Map::packTilesets()
 {
-	m_mapID = id;
-	m_map.ParseFile( map );
-
-	if ( m_map.HasError() )
-		throw Exception( m_map.GetErrorText().c_str() );
+	// Pixels of each tile's edge that are repeated around it to stop neighbours bleeding in
+	static const unsigned EXTRUDE = 1U;
+	static const unsigned ATLAS_MAX_SIZE = 2048U;
 
-	m_collision = nullptr;
-	std::fill( m_neighbors.begin(), m_neighbors.end(), std::make_pair( nullptr, 0 ) );
+	const unsigned cellWidth = TILE_WIDTH + EXTRUDE * 2;
+	const unsigned cellHeight = TILE_HEIGHT + EXTRUDE * 2;
 
-	// Load tilesets
 	const auto& tilesets = m_map.GetTilesets();
-	for ( auto it = tilesets.begin(); it != tilesets.end(); ++it )
+	const auto& layers = m_map.GetLayers();
+
+	// Find which gids are used by any layer
+	std::vector< bool > used;
+	for ( auto it = layers.begin(); it != layers.end(); ++it )
+		for ( int y = 0; y < (*it)->GetHeight(); y++ )
+			for ( int x = 0; x < (*it)->GetWidth(); x++ )
+			{
+				const Tmx::MapTile& tile = (*it)->GetTile( x, y );
+				if ( tile.tileset == nullptr ) continue;
+
+				unsigned gid = tile.tileset->GetFirstGid() + tile.id;
+				if ( used.size() <= gid )
+					used.resize( gid + 1, false );
+				used[ gid ] = true;
+			}
+
+	m_atlases.clear();
+	m_frames.assign( std::max< std::size_t >( used.size(), 1U ), TileFrame() );
+
+	// Gather the source rect of every used tile
+	std::vector< sf::Image > images( tilesets.size() );
+	std::vector< std::pair< unsigned, std::pair< std::size_t, sf::IntRect > > > tiles;
+
+	for ( std::size_t i = 0; i < tilesets.size(); i++ )
 	{
-		const std::string& base = (*it)->GetSource();
+		const Tmx::Tileset& tileset = *tilesets[ i ];
+		const std::string& base = tileset.GetSource();
 
 		std::string file;
 		if ( !base.empty() ) // If externally loaded, prepend the location minus the final '/'
 			file = base.substr( 0, base.find_last_of( '/' ) + 1 );
-		file += (*it)->GetImage()->GetSource();
+		file += tileset.GetImage()->GetSource();
+
+		if ( !images[ i ].loadFromFile( file ) )
+			throw Exception( "Failed to load tileset \"" + file + "\"" );
 
-		std::shared_ptr< sf::Texture > texture = res::loadTexture( file );
-		m_textures.insert( std::make_pair( *it, texture ) );
+		const unsigned columns = images[ i ].getSize().x / TILE_WIDTH;
+		const unsigned count = columns * ( images[ i ].getSize().y / TILE_HEIGHT );
+		const unsigned firstGid = tileset.GetFirstGid();
+
+		for ( unsigned id = 0; id < count && firstGid + id < used.size(); id++ )
+			if ( used[ firstGid + id ] )
+			{
+				sf::IntRect rect( id % columns * TILE_WIDTH, id / columns * TILE_HEIGHT, TILE_WIDTH, TILE_HEIGHT );
+				tiles.push_back( std::make_pair( firstGid + id, std::make_pair( i, rect ) ) );
+			}
 	}
 
-	// Load layers
-	const auto& layers = m_map.GetLayers();
-	for ( auto it = layers.begin(); it != layers.end(); ++it )
+	// Lay the tiles out on a grid of cells, starting a new atlas once one is full
+	const unsigned maxSize = std::min( sf::Texture::getMaximumSize(), ATLAS_MAX_SIZE );
+	const unsigned columns = maxSize / cellWidth;
+	const unsigned perAtlas = columns * ( maxSize / cellHeight );
+
+	for ( std::size_t first = 0; first < tiles.size(); first += perAtlas )
 	{
-		const auto& properties = (*it)->GetProperties().GetList();
-		bool add = true, upper = false;
+		const std::size_t count = std::min< std::size_t >( perAtlas, tiles.size() - first );
+		const unsigned rows = ( count + columns - 1 ) / columns;
+
+		sf::Image atlas;
+		atlas.create( std::min< std::size_t >( count, columns ) * cellWidth, rows * cellHeight, sf::Color::Transparent );
 
-		if ( m_collision == nullptr )
+		std::unique_ptr< sf::Texture > texture( new sf::Texture() );
+
+		for ( std::size_t i = 0; i < count; i++ )
 		{
-			std::string name = (*it)->GetName();
-			std::transform( name.begin(), name.end(), name.begin(), ::tolower );
-			if ( name == "collision" )
+			const sf::Image& image = images[ tiles[ first + i ].second.first ];
+			const sf::IntRect& src = tiles[ first + i ].second.second;
+
+			const unsigned x = i % columns * cellWidth + EXTRUDE;
+			const unsigned y = i / columns * cellHeight + EXTRUDE;
+			const int right = src.left + src.width - 1, bottom = src.top + src.height - 1;
+
+			atlas.copy( image, x, y, src );
+
+			// Extrude the edges and corners
+			for ( unsigned e = 1; e <= EXTRUDE; e++ )
 			{
-				m_collision = *it;
-				continue;
+				atlas.copy( image, x, y - e, sf::IntRect( src.left, src.top, src.width, 1 ) );
+				atlas.copy( image, x, y + src.height + e - 1, sf::IntRect( src.left, bottom, src.width, 1 ) );
+				atlas.copy( image, x - e, y, sf::IntRect( src.left, src.top, 1, src.height ) );
+				atlas.copy( image, x + src.width + e - 1, y, sf::IntRect( right, src.top, 1, src.height ) );
+
+				for ( unsigned f = 1; f <= EXTRUDE; f++ )
+				{
+					atlas.setPixel( x - e, y - f, image.getPixel( src.left, src.top ) );
+					atlas.setPixel( x + src.width + e - 1, y - f, image.getPixel( right, src.top ) );
+					atlas.setPixel( x - e, y + src.height + f - 1, image.getPixel( src.left, bottom ) );
+					atlas.setPixel( x + src.width + e - 1, y + src.height + f - 1, image.getPixel( right, bottom ) );
+				}
 			}
+
+			TileFrame& frame = m_frames[ tiles[ first + i ].first ];
+			frame.texture = texture.get();
+			frame.rect = sf::IntRect( x, y, src.width, src.height );
 		}
 
+		if ( !texture->loadFromImage( atlas ) )
+			throw Exception( "Failed to create a tileset atlas" );
+		m_atlases.push_back( std::move( texture ) );
+	}
+}
+
+void Map::selectLayers()
+{
+	m_lower.clear();
+	m_upper.clear();
+
+	const auto& layers = m_map.GetLayers();
+	for ( auto it = layers.begin(); it != layers.end(); ++it )
+	{
+		if ( *it == m_collision ) continue;
+
+		const auto& properties = (*it)->GetProperties().GetList();
+		bool add = true, upper = false;
+
 		auto findSeason = properties.find( "season" );
 		if ( findSeason != properties.end() )
 			add = time::parseSeasons( findSeason->second )[ m_season ];
@@ -233,6 +506,138 @@ void Map::load( unsigned id, const std::string& map )
 		if ( add ) 
 			( upper ? m_upper : m_lower ).push_back( *it );
 	}
+}
+
+void Map::season( time::Season s )
+{
+	if ( m_season == s ) return;
+	m_season = s;
+
+	// Only the chunks whose seasonal layers actually differ are recomposited
+	selectLayers();
+	buildChunks( m_lower, m_lowerChunks );
+	buildChunks( m_upper, m_upperChunks );
+}
+
+void Map::releaseCaches()
+{
+	for ( Chunk& chunk : m_lowerChunks )
+		chunk.cache.reset();
+	for ( Chunk& chunk : m_upperChunks )
+		chunk.cache.reset();
+}
+
+void Map::buildCollision()
+{
+	m_collisionBits.clear();
+	if ( !m_collision )
+		return;
+
+	m_collisionBits.resize( ( getWidth() * getHeight() + 31 ) / 32, 0 );
+	for ( unsigned y = 0; y < getHeight(); y++ )
+		for ( unsigned x = 0; x < getWidth(); x++ )
+			if ( m_collision->GetTile( x, y ).tileset != 0 )
+			{
+				unsigned i = y * getWidth() + x;
+				m_collisionBits[ i >> 5 ] |= 1U << ( i & 31 );
+			}
+}
+
+bool Map::checkObjectCollision( const sf::Vector2f& pos ) const
+{
+	if ( !m_collision ) 
+		return false;
+
+	// Local candidates, as hasCollision may run a script that queries the map again
+	std::vector< std::size_t > candidates;
+	m_objectGrid.query( pos, candidates );
+	for ( std::size_t i : candidates )
+	{
+		const Map::Object * obj = m_objects[ i ];
+		if ( obj->getBounds().contains( pos ) && obj->hasCollision( pos - obj->getPosition() ) )
+			return true;
+	}
+	return false;
+}
+
+Map::Contact Map::sweep( const sf::FloatRect& box, const sf::Vector2f& delta ) const
+{
+	Contact contact = { 1.0f, sf::Vector2f( 0.0f, 0.0f ) };
+	if ( !m_collision || ( delta.x == 0.0f && delta.y == 0.0f ) )
+		return contact;
+
+	// Broadphase: the area covered by the box over the whole move
+	sf::FloatRect area( std::min( box.left, box.left + delta.x ), std::min( box.top, box.top + delta.y ),
+						box.width + std::abs( delta.x ), box.height + std::abs( delta.y ) );
+
+	int left	= std::max( 0, (int) std::floor( area.left / TILE_WIDTH ) );
+	int top		= std::max( 0, (int) std::floor( area.top / TILE_HEIGHT ) );
+	int right	= std::min( (int) getWidth() - 1, (int) std::floor( ( area.left + area.width ) / TILE_WIDTH ) );
+	int bottom	= std::min( (int) getHeight() - 1, (int) std::floor( ( area.top + area.height ) / TILE_HEIGHT ) );
+
+	for ( int y = top; y <= bottom; y++ )
+		for ( int x = left; x <= right; x++ )
+			if ( checkTileCollision( sf::Vector2u( x, y ) ) )
+				sweepBox( box, delta, sf::FloatRect( (float) x * TILE_WIDTH, (float) y * TILE_HEIGHT, TILE_WIDTH, TILE_HEIGHT ), contact );
+
+	// Objects only report collision per point, so sample each tile of the object the move covers
+	// Local candidates, as hasCollision may run a script that queries the map again
+	std::vector< std::size_t > candidates;
+	m_objectGrid.query( area, candidates );
+	for ( std::size_t i : candidates )
+	{
+		const Map::Object * obj = m_objects[ i ];
+		const sf::FloatRect& bounds = obj->getBounds();
+
+		for ( int y = top; y <= bottom; y++ )
+			for ( int x = left; x <= right; x++ )
+			{
+				sf::FloatRect cell;
+				if ( !bounds.intersects( sf::FloatRect( (float) x * TILE_WIDTH, (float) y * TILE_HEIGHT, TILE_WIDTH, TILE_HEIGHT ), cell ) )
+					continue;
+
+				sf::Vector2f center( cell.left + cell.width / 2.0f, cell.top + cell.height / 2.0f );
+				if ( obj->hasCollision( center - obj->getPosition() ) )
+					sweepBox( box, delta, cell, contact );
+			}
+	}
+
+	return contact;
+}
+
+void Map::load( unsigned id, const std::string& map )
+{
+	m_mapID = id;
+	m_map.ParseFile( map );
+
+	if ( m_map.HasError() )
+		throw Exception( m_map.GetErrorText().c_str() );
+
+	m_collision = nullptr;
+	m_collisionRevision = 0U;
+	std::fill( m_neighbors.begin(), m_neighbors.end(), std::make_pair( nullptr, 0 ) );
+
+	// Pack the tiles the map uses into atlases
+	packTilesets();
+
+	// Find the collision layer
+	const auto& layers = m_map.GetLayers();
+	for ( auto it = layers.begin(); it != layers.end() && m_collision == nullptr; ++it )
+	{
+		std::string name = (*it)->GetName();
+		std::transform( name.begin(), name.end(), name.begin(), ::tolower );
+		if ( name == "collision" )
+			m_collision = *it;
+	}
+	buildCollision();
+
+	// Load layers for the current season
+	m_season = Time::singleton().getDate().getSeason();
+	selectLayers();
+
+	// Batch the layers into chunks
+	buildChunks( m_lower, m_lowerChunks );
+	buildChunks( m_upper, m_upperChunks );
 
 	// Load objects
 	const auto& objects = m_map.GetObjectGroups();
@@ -246,7 +651,7 @@ void Map::load( unsigned id, const std::string& map )
 
 			try
 			{
-				m_objects.push_back( generateObject( object ) );
+				m_objects.push_back( generateObject( object, *this ) );
 			}
 			catch ( std::exception& err )
 			{
@@ -254,6 +659,8 @@ void Map::load( unsigned id, const std::string& map )
 			}
 		}
 	}
+
+	indexObjects();
 	
 	const auto & properties = m_map.GetProperties().GetList();
 	auto find = properties.find( "type" );
@@ -291,11 +698,9 @@ void Map::reloadObject( const std::string & objStr )
 		// retrieve the object and delete it (note: the address is still exists)
 		obj = *objItr;
 		objTmx = &obj->getObject();
+		m_objectGrid.remove( objItr - m_objects.begin(), obj->getBounds() );
 		delete obj;
 	
-		// erase from objects vector
-		m_objects.erase( objItr );
-	
 		// if in active objects, find and remove it
 		auto find = std::find( m_activeObjects.begin(), m_activeObjects.end(), obj );
 		if ( find != m_activeObjects.end() ) m_activeObjects.erase( find );
@@ -313,28 +718,85 @@ void Map::reloadObject( const std::string & objStr )
 					objTmx = &object;
 			}
 		}
+
+		if ( objTmx == nullptr )
+			throw Exception( "Map object \"" + objStr + "\" does not exist" );
 	}
 	
-	// generate the object
-	obj = generateObject( *objTmx );
+	// generate the object, keeping its place in the object vector
+	std::size_t index = objItr - m_objects.begin();
+	try
+	{
+		obj = generateObject( *objTmx, *this );
+	}
+	catch ( ... )
+	{
+		// the old object is gone; drop its slot and shift the indices down
+		if ( objItr != m_objects.end() )
+		{
+			m_objects.erase( objItr );
+			indexObjects();
+			invalidateCollision();
+		}
+		throw;
+	}
 	
-	// add the object to the object vector
-	m_objects.push_back( obj );
+	if ( objItr != m_objects.end() )
+		*objItr = obj;
+	else
+		m_objects.push_back( obj );
+
+	m_objectGrid.insert( index, obj->getBounds() );
+	listUpdating();
+	invalidateCollision();
+}
+
+void Map::indexObjects()
+{
+	// Objects are bucketed in 4x4 tile cells
+	m_objectGrid.reset( (float) getWidth() * TILE_WIDTH, (float) getHeight() * TILE_HEIGHT, 4.0f * TILE_WIDTH );
+	for ( std::size_t i = 0; i < m_objects.size(); i++ )
+		m_objectGrid.insert( i, m_objects[ i ]->getBounds() );
+
+	listUpdating();
+}
+
+void Map::listUpdating()
+{
+	m_updating.clear();
+	for ( Map::Object * object : m_objects )
+		if ( object->getCallbacks() & Object::OnUpdate )
+			m_updating.push_back( object );
 }
 
 void Map::update( sf::Uint32 frameTime, const sf::Vector2f& pos )
 {
+	// Follow the season, along with the neighbors drawn around this map
+	const time::Season s = Time::singleton().getDate().getSeason();
+	season( s );
+	for ( auto& neighbor : m_neighbors )
+		if ( neighbor.first )
+			neighbor.first->season( s );
+
 	// Check if the player has left any of the active objects and call their onExit
-	for ( Map::Object * object : m_activeObjects )
+	for ( auto it = m_activeObjects.begin(); it != m_activeObjects.end(); )
+	{
+		Map::Object * object = *it;
 		if ( !object->getBounds().contains( pos ) )
 		{
-			try { object->onExit( frameTime, pos - object->getPosition() ); }
-			catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
-			m_activeObjects.erase( std::find( m_activeObjects.begin(), m_activeObjects.end(), object ) );
+			if ( object->getCallbacks() & Object::OnExit )
+			{
+				try { object->onExit( frameTime, pos - object->getPosition() ); }
+				catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+			}
+			it = m_activeObjects.erase( it );
 		}
+		else
+			++it;
+	}
 
-	// Update all objects on the map
-	for ( Map::Object * object : m_objects )
+	// Update the objects on the map that have an update
+	for ( Map::Object * object : m_updating )
 	{
 		try { object->update( frameTime, pos - object->getPosition() ); }
 		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
@@ -343,18 +805,26 @@ void Map::update( sf::Uint32 frameTime, const sf::Vector2f& pos )
 	// Update all active objects
 	for ( Map::Object * object : m_activeObjects )
 	{
+		if ( !( object->getCallbacks() & Object::WhileInside ) )
+			continue;
 		try { object->whileInside( frameTime, pos - object->getPosition() ); }
 		catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
 	}
 
 	// Check if the player has entered any new objects
-	for ( Map::Object * object : m_objects )
+	// Copy the candidates as onEnter may query the map again
+	std::vector< std::size_t > candidates;
+	m_objectGrid.query( pos, candidates );
+	for ( std::size_t i : candidates )
 	{
-		const sf::FloatRect& rect = object->getBounds();
-		if ( rect.contains( pos ) && std::find( m_activeObjects.begin(), m_activeObjects.end(), object ) == m_activeObjects.end() )
+		Map::Object * object = m_objects[ i ];
+		if ( object->getBounds().contains( pos ) && std::find( m_activeObjects.begin(), m_activeObjects.end(), object ) == m_activeObjects.end() )
 		{
-			try { object->onEnter( frameTime, pos - object->getPosition() ); }
-			catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+			if ( object->getCallbacks() & Object::OnEnter )
+			{
+				try { object->onEnter( frameTime, pos - object->getPosition() ); }
+				catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+			}
 			m_activeObjects.push_back( object );
 		}
 	}
@@ -363,11 +833,20 @@ void Map::update( sf::Uint32 frameTime, const sf::Vector2f& pos )
 bool Map::interact( const sf::Vector2f& pos )
 {
 	bool ret = false;
-	for ( Map::Object * obj : m_objects )
-		if ( obj->getBounds().contains( pos ) )
+
+	// Copy the candidates as a callback may query the map again
+	std::vector< std::size_t > candidates;
+	m_objectGrid.query( pos, candidates );
+
+	for ( std::size_t i : candidates )
+		if ( m_objects[ i ]->getBounds().contains( pos ) )
 		{
-			try { obj->onInteract( pos - obj->getPosition() ); }
-			catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+			Map::Object * obj = m_objects[ i ];
+			if ( obj->getCallbacks() & Object::OnInteract )
+			{
+				try { obj->onInteract( pos - obj->getPosition() ); }
+				catch ( std::exception & err ) { Console::singleton() << con::setcerr << err.what() << con::endl; }
+			}
 			ret = true;
 		}
 	return ret;
@@ -417,25 +896,38 @@ void MapViewer::draw( sf::RenderTarget& target, sf::RenderStates states ) const
 		draw.top = m_map->getHeight() - draw.height;
 
 	// Render lower layer
-	renderLayer( target, states, *m_map, m_map->getLowerLayers(), rect, draw );
+	renderChunks( target, states, *m_map, m_map->getLowerChunks(), rect );
 
+	// Gather objects and characters into one batch, so they overlap by where they stand
 	// Draw objects -- WARNING: UGLY CODE
 	const auto& objects = m_map->getObjects();
-	for ( auto it = objects.begin(); it != objects.end(); ++it )
+	m_map->queryObjects( rect, m_visible );
+	m_direct.clear();
+	for ( std::size_t i : m_visible )
 	{
-		const sf::FloatRect& objRect = (*it)->getBounds();
+		const sf::FloatRect& objRect = objects[ i ]->getBounds();
 		if ( rect.intersects( objRect ) )
 		{
-			Map::Object& object = const_cast< Map::Object& >( **it );
+			Map::Object& object = const_cast< Map::Object& >( *objects[ i ] );
 			object.setPosition( objRect.left - rect.left, objRect.top - rect.top );
 
-			target.draw( **it, states );
-
-			// Reset it
-			object.setPosition( objRect.left, objRect.top );
+			if ( !object.batch( m_batch, sf::Transform::Identity ) )
+				m_direct.push_back( &object );
+			else // Reset it
+				object.setPosition( objRect.left, objRect.top );
 		}
 	}
 
+	// The ground goes under the objects that draw themselves
+	m_batch.flush( target, states, gfx::SpriteBatch::Ground );
+	for ( Map::Object * object : m_direct )
+	{
+		target.draw( *object, states );
+
+		// Reset it
+		object->setPosition( object->getBounds().left, object->getBounds().top );
+	}
+
 	// Render character(s)
 	for ( auto it = m_characters.begin(); it != m_characters.end(); ++it )
 	{
@@ -444,9 +936,17 @@ void MapViewer::draw( sf::RenderTarget& target, sf::RenderStates states ) const
 		{
 			sf::Sprite sprite = c.toSprite();
 			sprite.move( -rect.left, -rect.top );
-			target.draw( sprite, states );
+			m_batch.add( sprite, sf::Transform::Identity );
+		}
+	}
+
+	m_batch.flush( target, states );
 
-			if ( DEBUG_COLLISION )
+	if ( DEBUG_COLLISION )
+		for ( auto it = m_characters.begin(); it != m_characters.end(); ++it )
+		{
+			const Character& c = **it;
+			if ( c.getMapID() == m_map->getID() && rect.intersects( c.getBounds() ) )
 			{
 				sf::FloatRect bounds = c.getBounds();
 
@@ -458,10 +958,9 @@ void MapViewer::draw( sf::RenderTarget& target, sf::RenderStates states ) const
 				target.draw( col, states );
 			}
 		}
-	}
 			
 	// Render upper layer
-	renderLayer( target, states, *m_map, m_map->getUpperLayers(), rect, draw );
+	renderChunks( target, states, *m_map, m_map->getUpperChunks(), rect );
 
 	// Optional: Render the collision layer
 	if ( DEBUG_COLLISION && m_map->getCollisionLayer() )
@@ -617,7 +1116,10 @@ class Field : public Map::Object, res::TextureLoader<>
 			farm::field::Tile & tile = farm::field::getTile( fpos.x, fpos.y );	
 			
 			if ( tile.water )
+			{
 				farm::field::placeStone( fpos.x, fpos.y, 1 );
+				getMap().invalidateCollision();
+			}
 			else if ( tile.till > 0 )
 				tile.water = true;
 			else
@@ -629,6 +1131,11 @@ class Field : public Map::Object, res::TextureLoader<>
 		}
 	}
 	
+	unsigned getCallbacks() const
+	{
+		return OnInteract | HasCollision;
+	}
+	
 	bool hasCollision( const sf::Vector2f & pos ) const
 	{
 		const sf::Vector2i fpos = convert( pos );
@@ -664,6 +1171,34 @@ class Field : public Map::Object, res::TextureLoader<>
 		for ( field::Object * obj : objects )
 			target.draw( *obj, states );
 	}
+
+	bool batch( gfx::SpriteBatch & batch, const sf::Transform & transform ) const
+	{
+		using namespace bf::farm;
+
+		const sf::Transform t = transform * getTransform();
+
+		sf::Sprite sprite( getTexture() );
+		const field::Tile * tiles = field::getTiles();
+
+		// tilled tiles lie flat under everything else
+		for ( int i = 0; i < FIELD_SIZE; i++ )
+		{
+			const field::Tile & tile = tiles[i];
+			if ( tile.till > 0 )
+			{
+				sprite.setPosition( i % field::WIDTH * TILE_WIDTH, i / field::WIDTH * TILE_HEIGHT );
+				sprite.setTextureRect( sf::IntRect( tile.water ? 32 : 0, 0, 32, 32 ) );
+				batch.add( sprite, t, gfx::SpriteBatch::Ground );
+			}
+		}
+
+		const std::vector< field::Object * > & objects = field::getObjects();
+		for ( field::Object * obj : objects )
+			obj->batch( batch, t );
+
+		return true;
+	}
 };
 
 /***************************************************************************/
@@ -671,8 +1206,11 @@ class Field : public Map::Object, res::TextureLoader<>
 static int lua_addImage( lua_State * l );
 static int lua_addText( lua_State * l );
 static int lua_bounds( lua_State * l );
+static int lua_invalidateCollision( lua_State * l );
 static int lua_removeImage( lua_State * l );
 static int lua_removeText( lua_State * l );
+static int lua_setCollisionRects( lua_State * l );
+static int lua_setCollisionTiles( lua_State * l );
 
 static const char * SCRIPT_MT = "map.script";
 static const char * SCRIPT_OBJ = "__object";
@@ -682,39 +1220,141 @@ static const struct luaL_Reg SCRIPT_LIB [] =
 	{ "addImage",		lua_addImage },
 	{ "addText",		lua_addText },
 	{ "bounds",		lua_bounds },
+	{ "invalidateCollision",	lua_invalidateCollision },
 	{ "removeImage",	lua_removeImage },
 	{ "removeText",	lua_removeText },
+	{ "setCollisionRects",	lua_setCollisionRects },
+	{ "setCollisionTiles",	lua_setCollisionTiles },
 	{ NULL, NULL },
 };
 
+//-------------------------------------------------------------------------
+// A script object's collision is answered in one of three ways
+//
+//	Callback	table:hasCollision( x, y ) is called on every query (the default)
+//	Rects		self:setCollisionRects{ { x, y, w, h }, ... } declares static rects
+//	Tiles		self:setCollisionTiles{ 0, 1, ... } declares a row-major mask, one entry per tile
+//				self:setCollisionTiles() instead samples table:hasCollision once per tile,
+//				and again only after self:invalidateCollision()
+//
+// Whatever the mode, self:invalidateCollision() tells the map that cached paths may be stale
+//
+// Coordinates are relative to the object
+//
+// The table's callbacks (update, onEnter, whileInside, onExit, interact, hasCollision) are looked up
+// once, after table:load; functions added to the table later are not called
+//-------------------------------------------------------------------------
 class Script : public Map::Object, public lua::Container
 {
 	lua_State * m_lua;
 	int ref;
 
+public:
+	enum CollisionMode { CollisionCallback, CollisionRects, CollisionTiles };
+
+	void setCollisionRects( std::vector< sf::FloatRect >&& rects )
+	{
+		m_collisionMode = CollisionRects;
+		m_collisionRects = std::move( rects );
+		getMap().invalidateCollision();
+	}
+
+	// An empty mask is sampled from table:hasCollision
+	void setCollisionTiles( std::vector< bool >&& mask )
+	{
+		m_collisionMode = CollisionTiles;
+		m_collisionDirty = mask.empty();
+		m_collisionTiles = std::move( mask );
+		m_collisionTiles.resize( getColumns() * getRows(), false );
+		getMap().invalidateCollision();
+	}
+
+	// Also tells the map, so scripts answering through the callback should call this when it changes
+	void invalidateCollision() 
+	{ 
+		m_collisionDirty = m_collisionMode == CollisionTiles;
+		getMap().invalidateCollision();
+	}
+
+	unsigned getColumns() const { return (unsigned) std::ceil( getBounds().width / TILE_WIDTH ); }
+	unsigned getRows() const { return (unsigned) std::ceil( getBounds().height / TILE_HEIGHT ); }
+
+private:
+	CollisionMode m_collisionMode;
+	std::vector< sf::FloatRect > m_collisionRects;
+	mutable std::vector< bool > m_collisionTiles;
+	mutable bool m_collisionDirty;
+
 	class LuaException : public Exception { public: LuaException( lua_State * l ) { *this << lua_tostring( l, -1 ); lua_pop( l, 1 ); } };
 	
-	static bool pushTableFunction( lua_State * l, int ref, const char * fn )
+	// The table's callbacks, looked up once when the script is loaded
+	enum Slot { SlotUpdate, SlotEnter, SlotInside, SlotExit, SlotInteract, SlotCollision, SLOT_COUNT };
+	std::array< int, SLOT_COUNT > m_refs;
+	unsigned m_callbacks;
+
+	// Pushes a callback and the table to call it on, if the script has it
+	bool pushCallback( Slot slot ) const
 	{
+		if ( m_refs[ slot ] == LUA_NOREF )
+			return false;
+		lua_rawgeti( m_lua, LUA_REGISTRYINDEX, m_refs[ slot ] );
+		lua_rawgeti( m_lua, LUA_REGISTRYINDEX, ref );
+		return true;
+	}
+
+	void resolveCallbacks()
+	{
+		static const struct { unsigned bit; const char * name; } CALLBACKS[ SLOT_COUNT ] =
+		{
+			{ OnUpdate,		"update" },
+			{ OnEnter,		"onEnter" },
+			{ WhileInside,	"whileInside" },
+			{ OnExit,		"onExit" },
+			{ OnInteract,	"interact" },
+			{ HasCollision,	"hasCollision" },
+		};
+
+		lua_State * l = m_lua;
+		m_callbacks = 0U;
+
 		lua_rawgeti( l, LUA_REGISTRYINDEX, ref );
-		lua_getfield( l, -1, fn );
-		if ( !lua_isfunction( l, -1 ) )
+		for ( int i = 0; i < SLOT_COUNT; i++ )
 		{
-			lua_pop( l, 2 );
-			return false;
+			lua_getfield( l, -1, CALLBACKS[ i ].name );
+			if ( lua_isfunction( l, -1 ) )
+			{
+				m_refs[ i ] = luaL_ref( l, LUA_REGISTRYINDEX );
+				m_callbacks |= CALLBACKS[ i ].bit;
+			}
+			else
+			{
+				m_refs[ i ] = LUA_NOREF;
+				lua_pop( l, 1 );
+			}
 		}
-		lua_pushvalue( l, -2 );
-		lua_remove( l, -3 );
-		return true;
+		lua_pop( l, 1 );
+	}
+
+	unsigned getCallbacks() const
+	{
+		return m_callbacks;
 	}
 	
 	~Script()
 	{
+		for ( int r : m_refs )
+			luaL_unref( m_lua, LUA_REGISTRYINDEX, r );
 		luaL_unref( m_lua, LUA_REGISTRYINDEX, ref );
 	}
 	
 	void load( const Tmx::Object & object )
 	{
+		m_collisionMode = CollisionCallback;
+		m_collisionDirty = false;
+		m_refs.fill( LUA_NOREF );
+		ref = LUA_NOREF;
+		m_callbacks = 0U;
+		
 		const auto & list = object.GetProperties().GetList();
 		
 		auto find = list.find( "script" );
@@ -722,8 +1362,10 @@ class Script : public Map::Object, public lua::Container
 		
 		lua_State * l = m_lua = lua::state();
 		
-		// execute the lua script, and retrieve a table
-		if ( luaL_loadfile( l, file.c_str() ) || lua_pcall( l, 0, 1, 0 ) )
+		lua::Profiler::Scope scope( getName(), "load" );
+		
+		// execute the lua script (compiled once per file), and retrieve a table
+		if ( lua::loadFile( file ) || lua_pcall( l, 0, 1, 0 ) )
 			throw LuaException( l );
 			
 		// ensure the returned value is a table
@@ -775,18 +1417,20 @@ class Script : public Map::Object, public lua::Container
 		
 		// register the table
 		ref = luaL_ref( l, LUA_REGISTRYINDEX );
+		resolveCallbacks();
 	}
 	
 	void update( sf::Uint32 ms, const sf::Vector2f & pos )
 	{
 		lua_State * l = m_lua;
-		if ( !pushTableFunction( l, ref, "update" ) )
+		if ( !pushCallback( SlotUpdate ) )
 			return;
 			
 		lua_pushunsigned( l, ms );
 		lua_pushnumber( l, pos.x );
 		lua_pushnumber( l, pos.y );
 		
+		lua::Profiler::Scope scope( getName(), "update" );
 		if ( lua_pcall( l, 4, 0, 0 ) )
 			throw LuaException( l );
 	}
@@ -794,13 +1438,14 @@ class Script : public Map::Object, public lua::Container
 	void onEnter( sf::Uint32 frameTime, const sf::Vector2f & pos )
 	{
 		lua_State * l = m_lua;
-		if ( !pushTableFunction( l, ref, "onEnter" ) )
+		if ( !pushCallback( SlotEnter ) )
 			return;
 			
 		lua_pushinteger( l, frameTime );
 		lua_pushnumber( l, pos.x );
 		lua_pushnumber( l, pos.y );
 		
+		lua::Profiler::Scope scope( getName(), "onEnter" );
 		if ( lua_pcall( l, 4, 0, 0 ) )
 			throw LuaException( l );
 	}
@@ -808,13 +1453,14 @@ class Script : public Map::Object, public lua::Container
 	void whileInside( sf::Uint32 ms, const sf::Vector2f & pos )
 	{
 		lua_State * l = m_lua;
-		if ( !pushTableFunction( l, ref, "whileInside" ) )
+		if ( !pushCallback( SlotInside ) )
 			return;
 			
 		lua_pushinteger( l, ms );
 		lua_pushnumber( l, pos.x );
 		lua_pushnumber( l, pos.y );
 		
+		lua::Profiler::Scope scope( getName(), "whileInside" );
 		if ( lua_pcall( l, 4, 0, 0 ) )
 			throw LuaException( l );
 	}
@@ -822,13 +1468,14 @@ class Script : public Map::Object, public lua::Container
 	void onExit( sf::Uint32 ms, const sf::Vector2f & pos )
 	{
 		lua_State * l = m_lua;
-		if ( !pushTableFunction( l, ref, "onExit" ) )
+		if ( !pushCallback( SlotExit ) )
 			return;
 			
 		lua_pushinteger( l, ms );
 		lua_pushnumber( l, pos.x );
 		lua_pushnumber( l, pos.y );
 		
+		lua::Profiler::Scope scope( getName(), "onExit" );
 		if ( lua_pcall( l, 4, 0, 0 ) )
 			throw LuaException( l );
 	}
@@ -836,26 +1483,67 @@ class Script : public Map::Object, public lua::Container
 	void onInteract( const sf::Vector2f & pos )
 	{
 		lua_State * l = m_lua;
-		if ( !pushTableFunction( l, ref, "interact" ) )
+		if ( !pushCallback( SlotInteract ) )
 			return;
 		
 		lua_pushnumber( l, pos.x );
 		lua_pushnumber( l, pos.y );
 		
+		lua::Profiler::Scope scope( getName(), "interact" );
 		if ( lua_pcall( l, 3, 0, 0 ) )
 			throw LuaException( l );
 	}
 	
 	bool hasCollision( const sf::Vector2f & pos ) const
+	{
+		switch ( m_collisionMode )
+		{
+		case CollisionRects:
+			for ( const sf::FloatRect & rect : m_collisionRects )
+				if ( rect.contains( pos ) )
+					return true;
+			return false;
+
+		case CollisionTiles:
+		{
+			if ( m_collisionDirty )
+				sampleCollision();
+
+			if ( pos.x < 0.0f || pos.y < 0.0f )
+				return false;
+
+			unsigned x = (unsigned) pos.x / TILE_WIDTH, y = (unsigned) pos.y / TILE_HEIGHT;
+			return x < getColumns() && y < getRows() && m_collisionTiles[ y * getColumns() + x ];
+		}
+
+		default:
+			return callHasCollision( pos );
+		}
+	}
+
+	void sampleCollision() const
+	{
+		unsigned columns = getColumns(), rows = getRows();
+		for ( unsigned y = 0; y < rows; y++ )
+			for ( unsigned x = 0; x < columns; x++ )
+			{
+				sf::Vector2f center( ( x + 0.5f ) * TILE_WIDTH, ( y + 0.5f ) * TILE_HEIGHT );
+				m_collisionTiles[ y * columns + x ] = callHasCollision( center );
+			}
+		m_collisionDirty = false;
+	}
+
+	bool callHasCollision( const sf::Vector2f & pos ) const
 	{
 		lua_State * l = m_lua;
 		
-		if ( !pushTableFunction( l, ref, "hasCollision" ) )
+		if ( !pushCallback( SlotCollision ) )
 			return false;
 		
 		lua_pushnumber( l, pos.x );
 		lua_pushnumber( l, pos.y );
 		
+		lua::Profiler::Scope scope( getName(), "hasCollision" );
 		if ( lua_pcall( l, 3, 1, 0 ) )
 		{
 			Console::singleton() << con::setcerr << lua_tostring( l, -1 ) << con::endl;
@@ -925,6 +1613,18 @@ static int lua_bounds( lua_State * l )
 	return 4;
 }
 
+static int lua_invalidateCollision( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	
+	lua_getfield( l, 1, SCRIPT_OBJ );
+	Script ** obj = (Script **) luaL_checkudata( l, -1, SCRIPT_MT );
+	
+	(*obj)->invalidateCollision();
+	
+	return 0;
+}
+
 static int lua_removeImage( lua_State * l )
 {
 	luaL_checktype( l, 1, LUA_TTABLE );
@@ -955,9 +1655,66 @@ static int lua_removeText( lua_State * l )
 	return 0;
 }
 
+static int lua_setCollisionRects( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	luaL_checktype( l, 2, LUA_TTABLE );
+	
+	std::vector< sf::FloatRect > rects;
+	for ( int i = 1, n = (int) lua_rawlen( l, 2 ); i <= n; i++ )
+	{
+		lua_rawgeti( l, 2, i );
+		luaL_checktype( l, -1, LUA_TTABLE );
+		
+		float r[4];
+		for ( int j = 0; j < 4; j++ )
+		{
+			lua_rawgeti( l, -1 - j, j + 1 );
+			r[j] = (float) luaL_checknumber( l, -1 );
+		}
+		lua_pop( l, 5 );
+		
+		rects.push_back( sf::FloatRect( r[0], r[1], r[2], r[3] ) );
+	}
+	
+	lua_getfield( l, 1, SCRIPT_OBJ );
+	Script ** obj = (Script **) luaL_checkudata( l, -1, SCRIPT_MT );
+	
+	(*obj)->setCollisionRects( std::move( rects ) );
+	
+	return 0;
+}
+
+static int lua_setCollisionTiles( lua_State * l )
+{
+	luaL_checktype( l, 1, LUA_TTABLE );
+	
+	std::vector< bool > mask;
+	if ( !lua_isnoneornil( l, 2 ) )
+	{
+		luaL_checktype( l, 2, LUA_TTABLE );
+		for ( int i = 1, n = (int) lua_rawlen( l, 2 ); i <= n; i++ )
+		{
+			lua_rawgeti( l, 2, i );
+			mask.push_back( lua_isnumber( l, -1 ) ? lua_tonumber( l, -1 ) != 0 : lua_toboolean( l, -1 ) != 0 );
+			lua_pop( l, 1 );
+		}
+	}
+	
+	lua_getfield( l, 1, SCRIPT_OBJ );
+	Script ** obj = (Script **) luaL_checkudata( l, -1, SCRIPT_MT );
+	
+	if ( !mask.empty() && mask.size() != (*obj)->getColumns() * (*obj)->getRows() )
+		return luaL_error( l, "collision mask has %d tiles, expected %d", (int) mask.size(), (int) ( (*obj)->getColumns() * (*obj)->getRows() ) );
+	
+	(*obj)->setCollisionTiles( std::move( mask ) );
+	
+	return 0;
+}
+
 /***************************************************************************/
 
-Map::Object * generateObject( const Tmx::Object & tmxObject )
+Map::Object * generateObject( const Tmx::Object & tmxObject, Map & map )
 {
 	Map::Object * object = nullptr;
 
@@ -976,6 +1733,7 @@ Map::Object * generateObject( const Tmx::Object & tmxObject )
 		object->m_name = tmxObject.GetName();
 		object->m_bounds = sf::FloatRect( (float) tmxObject.GetX(), (float) tmxObject.GetY(), (float) tmxObject.GetWidth(), (float) tmxObject.GetHeight() );
 		object->m_object = &tmxObject;
+		object->m_map = &map;
 
 		object->load( tmxObject );
 		return object;
@@ -3,11 +3,14 @@
 #include "movespeed.h"
 #include "direction.h"
 
+#include <SFML/Config.hpp>
 #include <SFML/System/NonCopyable.hpp>
 #include <SFML/System/Time.hpp>
 #include <SFML/System/Vector2.hpp>
 
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace bf
@@ -19,15 +22,23 @@ namespace bf
 	
 	class Character;
 
+	//-------------------------------------------------------------------------
+	// Queued actions are compiled into a flat buffer of instructions, which
+	// updateCharacter runs with a program counter and a loop stack
+	// The buffer is released once the last instruction has finished
+	//-------------------------------------------------------------------------
 	class Actor : public virtual sf::NonCopyable
 	{
 	public:
-		Actor() : m_curRepeater( nullptr ) {}
+		Actor();
 		virtual ~Actor();
 
 		// Moves the character x tiles in a certain direction
 		Actor & move( Direction dir, MoveSpeed speed, unsigned tiles );
 
+		// Walks the character to a tile, finding a path around collision; optionally on another map
+		Actor & moveTo( const sf::Vector2i & tile, const std::string & map = "", MoveSpeed speed = Walk );
+
 		// Causes the character to face a certain direction
 		Actor & face( Direction dir, bool force = false );
 
@@ -41,27 +52,48 @@ namespace bf
 		Actor & wait( const time::Hour & hour );
 
 		// Repeats the next inputted events until a condition is satisified
-		Actor & repeatBegin( unsigned numTimes );		// Repeats n times
+		Actor & repeatBegin( unsigned numTimes );		// Repeats n times (0 repeats forever)
 		Actor & repeatBegin( const time::Hour & hour );	// Repeats until a time
 
 		// Stops adding events to the repeat stack
 		Actor & repeatEnd();
 
 		// Returns if there are actions
-		bool hasActions() const { return !m_actions.empty(); }
+		bool hasActions() const { return m_pc < m_program.size(); }
 
 	public:
-		class Action;
-		class Repeater;
+		class Runner;
 
 	protected:
 		void updateCharacter( Character & );		
 
 	private:
-		Actor & addAction( Action* );
+		struct Instruction
+		{
+			sf::Uint8 op;
+			sf::Uint8 dir;
+			sf::Uint8 speed;
+			sf::Uint32 arg;
+		};
+
+		struct Loop
+		{
+			sf::Uint32 begin;	// Index of the loop's first instruction
+			sf::Uint32 count;	// Iterations left
+		};
+
+		Actor & addInstruction( sf::Uint8 op, sf::Uint32 arg, sf::Uint8 dir = 0, sf::Uint8 speed = 0 );
+		sf::Uint32 addTarget( const sf::Vector2i & tile, const std::string & map );
 
 	private:
-		Repeater * m_curRepeater;
-		std::vector< Action * > m_actions;
+		std::vector< Instruction > m_program;
+		std::vector< std::pair< sf::Vector2i, std::string > > m_targets; // Tiles for moveTo and reposition
+		std::vector< sf::Uint32 > m_open; // Unclosed repeatBegin instructions
+
+		std::size_t m_pc;
+		bool m_started;
+		std::vector< Loop > m_loops;
+
+		std::unique_ptr< Runner > m_runner;
 	};
 }
@@ -31,7 +31,11 @@ namespace bf
 		Direction getDirection() const { return std::get< 0 >( m_move ); }
 
 		const sf::Vector2f& getPosition() const { return m_pos; }
-		void setPosition( const sf::Vector2f& pos ) { m_pos = pos; }
+		void setPosition( const sf::Vector2f& pos ) { m_pos = m_prevPos = m_drawPos = pos; }
+
+		// Places the sprite between the last two simulated positions
+		void interpolate( float alpha ) { m_drawPos = m_prevPos + ( m_pos - m_prevPos ) * alpha; }
+		const sf::Vector2f& getDrawPosition() const { return m_drawPos; }
 		
 		inline void enableCollision( bool b) { m_checkCollision = b; }
 
@@ -47,7 +51,7 @@ namespace bf
 		gfx::Spritesheet m_sheet;
 
 		unsigned m_mapID;
-		sf::Vector2f m_pos;
+		sf::Vector2f m_pos, m_prevPos, m_drawPos;
 		std::tuple< Direction, sf::Vector2f, bool > m_move;
 		
 		bool m_checkCollision;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "time/season.h"
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -11,7 +12,7 @@ namespace bf
 	
 	namespace gfx
 	{
-		class Spritesheet;
+		class AnimationSet;
 	}
 
 	namespace data
@@ -52,11 +53,14 @@ namespace bf
 		// Return the crop data with the inputted id
 		const data::Crop & getCrop( const std::string & id );
 		
-		// Generates the inputted spritesheet
-		void genSprite( const std::string & id, gfx::Spritesheet * sheet );
+		// Returns the animations of the inputted sprite, parsed on first use and shared afterwards
+		std::shared_ptr< const gfx::AnimationSet > getAnimations( const std::string & id );
 		
 		// Returns the map of string or integer id
 		bf::Map & getMap( unsigned id );
 		bf::Map & getMap( const std::string & id );
+		
+		// Returns the number of maps -- integer ids are [0,count)
+		unsigned getMapCount();
 	}
 }
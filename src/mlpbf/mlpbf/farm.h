@@ -9,6 +9,11 @@ namespace bf
 {
 	class Seed;
 
+	namespace gfx
+	{
+		class SpriteBatch;
+	}
+
 	namespace farm
 	{
 		void init();
@@ -28,6 +33,9 @@ namespace bf
 				virtual ~Object() {}
 				
 				virtual bool hasCollision() const = 0;
+
+				// Adds the object's sprites to batch, as draw() would draw them
+				virtual void batch( gfx::SpriteBatch& batch, const sf::Transform& transform ) const = 0;
 				
 				virtual unsigned getWidth() const = 0;
 				virtual unsigned getHeight() const = 0;
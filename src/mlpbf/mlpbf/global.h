@@ -24,6 +24,7 @@ namespace bf
 
 	extern bool DEBUG_COLLISION;
 	extern bool SHOW_FPS;
+	extern bool CACHE_MAP_LAYERS;
 
 	void showText( const std::string& message, const std::string& speaker = "" );
 	void showInventory();
@@ -3,15 +3,13 @@
 #include "../resource.h"
 #include <SFML/Graphics/Sprite.hpp>
 
+#include <algorithm>
+#include <vector>
+
 class TiXmlElement;
 
 namespace bf
 {
-	namespace util
-	{
-		class Timer;
-	}
-
 	namespace gfx
 	{
 		//-------------------------------------------------------------------------
@@ -21,8 +19,11 @@ namespace bf
 		//	dim:		the dimension of a single frame
 		//	reverse:	optional boolean value to play the animation backwards
 		//	flip:		optional boolean value to flip animation (for left-right)
+		//
+		//	The image is packed into a shared atlas; the subrect of each frame within it
+		//	is worked out once, in the order they are played
 		//-------------------------------------------------------------------------
-		class Animation : private res::TextureLoader<>
+		class Animation : private res::RegionLoader<>
 		{
 			public:
 				Animation( const TiXmlElement& elem );
@@ -31,14 +32,19 @@ namespace bf
 				unsigned getNumFrames() const { return m_numFrames; }
 				const sf::Vector2i& getDimensions() const { return m_dim; }
 
+				// Microseconds each frame is shown for
+				sf::Int64 getFrameTime() const { return m_frameTime; }
+				const sf::IntRect& getFrameRect( unsigned frame ) const { return m_frames[ std::min( frame, m_numFrames - 1 ) ]; }
+
 				void update( sf::Sprite& sprite, unsigned frame ) const;
-				void setTimer( util::Timer& ) const;
 
 			private:
 				std::string m_id;
 				bool m_reverse, m_flip;
-				unsigned m_numFrames, m_frameTime;
+				unsigned m_numFrames;
+				sf::Int64 m_frameTime;
 				sf::Vector2i m_dim;
+				std::vector< sf::IntRect > m_frames;
 		};
 	}
 }
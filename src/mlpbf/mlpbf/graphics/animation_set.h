@@ -0,0 +1,44 @@
+#pragma once
+
+#include "animation.h"
+#include "../direction.h"
+#include "../movespeed.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <SFML/System/NonCopyable.hpp>
+
+class TiXmlElement;
+
+namespace bf
+{
+	namespace gfx
+	{
+		//-------------------------------------------------------------------------
+		// The animations parsed from one sprite file
+		// A set is built once per sprite and shared, read-only, by every spritesheet using it
+		//
+		// The movement animations ("<direction>.<speed>", e.g. "up.walk") are looked up
+		// when the set is built, so switching between them needs no string
+		//-------------------------------------------------------------------------
+		class AnimationSet : private sf::NonCopyable
+		{
+		public:
+			// Parses every <animation> child of the sprite file's root element
+			AnimationSet( const TiXmlElement& root );
+
+			// Returns nullptr if the set has no such animation
+			const Animation* find( const std::string& id ) const;
+			const Animation* find( Direction d, MoveSpeed m ) const { return m_movement[ d * SPEED_COUNT + m ]; }
+
+		private:
+			enum { SPEED_COUNT = Run + 1 };
+
+			std::unordered_map< std::string, std::unique_ptr< Animation > > m_animations;
+			std::array< const Animation*, 4 * SPEED_COUNT > m_movement; // Indexed by direction * SPEED_COUNT + speed
+		};
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+#include <vector>
+
+namespace bf
+{
+	namespace gfx
+	{
+		class Animation;
+
+		//-------------------------------------------------------------------------
+		// Advances the playing animation of every spritesheet, once per simulation step
+		//
+		// Each sheet owns one record in a compact array; the whole array is stepped in one pass
+		// by the game time that passed, so pausing or scaling util::Game pauses or scales
+		// every animation, and drawing a sheet only reads its current frame
+		//-------------------------------------------------------------------------
+		class Animator : private sf::NonCopyable
+		{
+		public:
+			struct Record
+			{
+				const Animation* anim;	// nullptr while nothing is playing
+				sf::Int64 elapsed;		// Microseconds spent on the current frame
+				unsigned frame;
+				bool loop;
+				bool finished;			// A non-looping animation has shown its last frame for its full time
+			};
+
+			static Animator& singleton();
+
+			unsigned add();
+			void remove( unsigned id );
+
+			// Restarts a record at the first frame of anim
+			void play( unsigned id, const Animation* anim, bool loop );
+
+			// Gives a record the same animation and phase as another
+			void copy( unsigned to, unsigned from ) { m_records[ to ] = m_records[ from ]; }
+
+			const Record& get( unsigned id ) const { return m_records[ id ]; }
+
+			// Steps every record by the game time passed since the last update
+			void update();
+
+		private:
+			Animator();
+
+		private:
+			std::vector< Record > m_records;
+			std::vector< unsigned > m_free;
+			sf::Int64 m_last;
+		};
+	}
+}
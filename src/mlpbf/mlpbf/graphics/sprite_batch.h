@@ -0,0 +1,62 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/Graphics/RenderStates.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+
+#include <utility>
+#include <vector>
+
+namespace sf
+{
+	class RenderTarget;
+	class Sprite;
+	class Texture;
+}
+
+namespace bf
+{
+	namespace gfx
+	{
+		//-------------------------------------------------------------------------
+		// Collects sprites during a draw and renders them in as few draw calls as it can
+		//
+		// Each sprite gets a 64-bit sort key: its layer, then the bottom edge of its bounds
+		// (so lower sprites overlap higher ones), then its texture. The keys are radix sorted,
+		// and every run of sprites sharing a texture is drawn as one vertex array
+		// Sprites with equal keys keep the order they were added in
+		//-------------------------------------------------------------------------
+		class SpriteBatch
+		{
+		public:
+			enum Layer
+			{
+				Ground = 0,	// Flat on the floor, under everything standing on the map; sorted by texture only
+				World,		// Characters and objects, sorted by where they stand
+			};
+
+			void add( const sf::Sprite& sprite, const sf::Transform& transform, sf::Uint8 layer = World );
+
+			// Sorts and draws everything added since the last flush on layers up to last, and takes it out of the batch
+			// Sprites on higher layers stay for a later flush
+			void flush( sf::RenderTarget& target, sf::RenderStates states, sf::Uint8 last = World );
+
+			std::size_t size() const { return m_sprites.size(); }
+
+		private:
+			struct Sprite
+			{
+				const sf::Texture* texture;
+				sf::Vertex quad[ 4 ];
+			};
+
+			void sort();
+
+		private:
+			std::vector< Sprite > m_sprites;
+			std::vector< std::pair< sf::Uint64, sf::Uint32 > > m_keys, m_swap; // ( key, sprite )
+			std::vector< const sf::Texture* > m_textures; // Index is the texture's part of the key
+			std::vector< sf::Vertex > m_vertices;
+		};
+	}
+}
@@ -1,11 +1,12 @@
 #pragma once
 
-#include "animation.h"
-#include "../utility/timer.h"
+#include "animation_set.h"
+#include "animator.h"
+#include "../direction.h"
+#include "../movespeed.h"
 
 #include <memory>
 #include <string>
-#include <unordered_map>
 
 #include <SFML/Graphics/Drawable.hpp>
 
@@ -21,38 +22,39 @@ namespace bf
 		//-------------------------------------------------------------------------
 		// This class is a sheet of sprites that can be animated
 		// Note: this class contains no rendering information, it is only logic
+		//
+		// The animations themselves are shared with every other sheet of the same sprite;
+		// which one is playing and its frame are kept in the sheet's Animator record
 		//-------------------------------------------------------------------------
 		class Spritesheet
 		{
 		public:
 			Spritesheet();
 			Spritesheet( const std::string& sprite );
+			Spritesheet( const Spritesheet& );
+			~Spritesheet();
+
+			Spritesheet& operator=( const Spritesheet& );
 
-			void addAnimation( const std::string&, std::unique_ptr< Animation > );
 			void animate( const std::string& anim, bool loop = true );
+			void animate( Direction d, MoveSpeed m, bool loop = true );
 
 			void load( const std::string& sprite );
 
 			bool finished() const;
 			operator bool() const { return finished(); }
 
-			const sf::Vector2i& getDimensions() const { return m_curAnim->getDimensions(); }
-			sf::Sprite& update( sf::Sprite& ) const;
+			const sf::Vector2i& getDimensions() const { return Animator::singleton().get( m_record ).anim->getDimensions(); }
 
-		public:
-			static void setGlobalState( bool state ) { s_active = state; }
+			// Sets the sprite to the current frame
+			sf::Sprite& update( sf::Sprite& ) const;
 
 		private:
-			std::unordered_map< std::string, std::unique_ptr< Animation > > m_animations;
-			Animation* m_curAnim;
-
-			bool m_loop;
-				
-			mutable unsigned m_frame;
-			mutable util::Timer m_timer;
+			void play( const Animation* anim, bool loop );
 
 		private:
-			static bool s_active;
+			std::shared_ptr< const AnimationSet > m_animations;
+			unsigned m_record;
 		};
 	} // namespace gfx
 } // namespace bf
\ No newline at end of file
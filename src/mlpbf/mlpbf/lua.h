@@ -2,9 +2,11 @@
 
 #include <cstdio>
 #include <deque>
+#include <string>
 #include <lua5.2/lua.hpp>
 #include <SFML/Graphics/Drawable.hpp>
 #include <SFML/Graphics/Transformable.hpp>
+#include <SFML/System/Time.hpp>
 
 namespace bf
 {
@@ -13,12 +15,17 @@ namespace bf
 		void init();
 		void cleanup();
 		
-		void update( unsigned ms );
+		// Runs the hooks; time they are passed is whole milliseconds, the remainder carries to the next update
+		void update( const sf::Time& time );
 		
 		void load( FILE * fp );
 		void save( FILE * fp );
 	
 		lua_State * state();
+
+		// Pushes the compiled chunk of a file, like luaL_loadfile
+		// Chunks are compiled once and reused until the file is modified
+		int loadFile( const std::string & file );
 		
 		struct Drawable;
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace bf
+{
+	namespace lua
+	{
+		//-------------------------------------------------------------------------
+		// The lua_Alloc of the game's Lua state
+		//
+		// Blocks of up to MAX_SMALL bytes are rounded up to a size class and carved out of
+		// SLAB_SIZE slabs; freed blocks go on their class's free list for the next allocation
+		// of that size, so the tables, strings and userdata that scripts churn through each
+		// frame don't reach malloc. Larger blocks go to malloc directly
+		// Slabs are only given back by release(), once the state is closed
+		//-------------------------------------------------------------------------
+		class Allocator : private sf::NonCopyable
+		{
+		public:
+			enum { GRANULARITY = 16, MAX_SMALL = 256, SLAB_SIZE = 16 * 1024 };
+
+			struct Stats
+			{
+				std::size_t live;			// Bytes Lua holds
+				std::size_t peak;			// Most bytes Lua has held at once
+				std::size_t slabs;			// Bytes reserved for small blocks
+				sf::Uint64 allocations;		// Blocks allocated so far
+			};
+
+			static Allocator& singleton();
+
+			// Matches lua_Alloc; ud is the allocator
+			static void* alloc( void* ud, void* ptr, std::size_t osize, std::size_t nsize );
+
+			const Stats& getStats() const { return m_stats; }
+
+			// Frees every slab; only valid once nothing allocated from them is in use
+			void release();
+
+		private:
+			Allocator();
+			~Allocator();
+
+			void* allocate( std::size_t size );
+			void deallocate( void* ptr, std::size_t size );
+			void* keep( void* ptr, std::size_t osize, std::size_t nsize );
+
+			static std::size_t sizeClass( std::size_t size ) { return ( size + GRANULARITY - 1 ) / GRANULARITY - 1; }
+
+		private:
+			struct Block { Block* next; };
+
+			std::array< Block*, MAX_SMALL / GRANULARITY > m_free;
+			std::vector< char* > m_slabs;
+			Stats m_stats;
+		};
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <lua5.2/lua.hpp>
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+namespace bf
+{
+	namespace lua
+	{
+		//-------------------------------------------------------------------------
+		// Measures what the game spends in Lua, while running
+		//
+		// Every call from C++ into Lua is timed through a Scope, keyed by the object it was
+		// made for (a map script, a hook, a console command) and the callback's name
+		// A count hook also samples the Lua stack every SAMPLE_INTERVAL instructions; the samples
+		// are written as folded stacks ("outer;inner;leaf count"), which flamegraph tools read
+		//-------------------------------------------------------------------------
+		class Profiler : private sf::NonCopyable
+		{
+		public:
+			enum { SAMPLE_INTERVAL = 1000 };
+
+			static Profiler& singleton();
+
+			void start();
+			void stop();
+			void clear();
+
+			bool isRunning() const { return m_running; }
+
+			// Writes the call timings, slowest first, one per line
+			void report( std::ostream& out ) const;
+
+			// Writes the sampled stacks; returns false if the file could not be opened
+			bool writeStacks( const std::string& file ) const;
+
+			// Times a call into Lua for as long as it is alive
+			// While the profiler is stopped it only checks the flag: the clock isn't read and the key isn't copied
+			class Scope : private sf::NonCopyable
+			{
+			public:
+				Scope( const std::string& object, const char* callback );
+				~Scope();
+
+			private:
+				bool m_timing;
+				sf::Int64 m_start; // us on the profiler's clock
+			};
+
+		private:
+			Profiler() : m_running( false ) {}
+
+			sf::Int64 now() const { return m_clock.getElapsedTime().asMicroseconds(); }
+
+			static void sample( lua_State* l, lua_Debug* ar );
+
+			typedef std::pair< std::string, std::string > Key; // ( object, callback )
+
+			struct Entry
+			{
+				Entry() : calls( 0U ), total( 0 ), max( 0 ) {}
+
+				unsigned calls;
+				sf::Int64 total, max; // us
+			};
+
+		private:
+			bool m_running;
+			sf::Clock m_clock;
+			std::map< Key, Entry > m_entries;
+			std::vector< Key > m_scopes; // Entry points currently inside Lua
+			std::unordered_map< std::string, unsigned > m_stacks;
+		};
+	}
+}
@@ -3,17 +3,20 @@
 #include <array>
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include <SFML/Graphics/Drawable.hpp>
+#include <SFML/Graphics/RenderTexture.hpp>
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Transformable.hpp>
+#include <SFML/Graphics/VertexArray.hpp>
 #include <SFML/System/NonCopyable.hpp>
 #include <Tmx.h>
 
 #include "direction.h"
+#include "graphics/sprite_batch.h"
 #include "time/season.h"
+#include "utility/spatial_grid.h"
 
 namespace bf
 {
@@ -25,6 +28,42 @@ namespace bf
 		~Map();
 	
 		class Object;
+
+		// The first point a moving box touches something solid
+		// time is the fraction of the move made before contact (1 if nothing was hit)
+		struct Contact
+		{
+			float time;
+			sf::Vector2f normal;
+		};
+
+		// Number of tiles along each side of a render chunk
+		enum { CHUNK_SIZE = 16 };
+
+		// The texture and subrect a tile is drawn from, resolved once at load
+		struct TileFrame
+		{
+			const sf::Texture* texture;
+			sf::IntRect rect;
+		};
+
+		//-------------------------------------------------------------------------
+		// A chunk is a CHUNK_SIZE x CHUNK_SIZE block of a layer stack, prebuilt into quads
+		// Batches are stored in draw order; each batch is one layer's tiles that share a texture
+		//
+		// If CACHE_MAP_LAYERS is set, the batches are composited once into cache
+		// and redrawn only after the chunk has been marked dirty
+		//-------------------------------------------------------------------------
+		struct Chunk
+		{
+			Chunk() : dirty( true ) {}
+
+			sf::FloatRect bounds;
+			std::vector< std::pair< const sf::Texture*, sf::VertexArray > > batches;
+
+			mutable std::unique_ptr< sf::RenderTexture > cache;
+			mutable bool dirty;
+		};
 	
 		void load( unsigned id, const std::string& );
 		void loadNeighbors();
@@ -34,14 +73,32 @@ namespace bf
 		void update( sf::Uint32 frameTime, const sf::Vector2f& pos );
 		bool interact( const sf::Vector2f& pos );
 
-		bool checkTileCollision( const sf::Vector2u& ) const;
+		// Tiles outside of the map never collide
+		bool checkTileCollision( const sf::Vector2u& pos ) const
+		{
+			if ( pos.x >= getWidth() || pos.y >= getHeight() || m_collisionBits.empty() )
+				return false;
+			unsigned i = pos.y * getWidth() + pos.x;
+			return ( m_collisionBits[ i >> 5 ] >> ( i & 31 ) ) & 1U;
+		}
+		bool isWalkable( const sf::Vector2u& pos ) const { return !checkTileCollision( pos ); }
 		bool checkObjectCollision( const sf::Vector2f& ) const;
 
-		void season( time::Season s ) { m_season = s; }
+		// Sweeps box along delta against solid tiles and object collision
+		Contact sweep( const sf::FloatRect& box, const sf::Vector2f& delta ) const;
+
+		void season( time::Season s );
 		time::Season season() const { return m_season; }
 		
 		bool isExterior() const { return m_isExterior; }
 
+		// Incremented whenever the collision of the map or its objects changes
+		unsigned getCollisionRevision() const { return m_collisionRevision; }
+		void invalidateCollision() { ++m_collisionRevision; }
+
+		// Frees the composited layer textures, e.g. after CACHE_MAP_LAYERS was turned off
+		void releaseCaches();
+
 	public: // Functions to help with rendering
 		unsigned getWidth() const { return m_map.GetWidth(); }
 		unsigned getHeight() const { return m_map.GetHeight(); }
@@ -50,11 +107,19 @@ namespace bf
 
 		const std::vector< Map::Object * >& getObjects() const { return m_objects; }
 
+		// Returns the indices into getObjects() of the objects that may intersect rect, in order
+		void queryObjects( const sf::FloatRect& rect, std::vector< std::size_t >& out ) const { m_objectGrid.query( rect, out ); }
+
 		const std::vector< const Tmx::Layer* >& getLowerLayers() const { return m_lower; }
 		const std::vector< const Tmx::Layer* >& getUpperLayers() const { return m_upper; }
 
 		const Tmx::Layer* getCollisionLayer() const { return m_collision; }
 
+		const std::vector< Chunk >& getLowerChunks() const { return m_lowerChunks; }
+		const std::vector< Chunk >& getUpperChunks() const { return m_upperChunks; }
+		unsigned getChunkColumns() const { return ( getWidth() + CHUNK_SIZE - 1 ) / CHUNK_SIZE; }
+		unsigned getChunkRows() const { return ( getHeight() + CHUNK_SIZE - 1 ) / CHUNK_SIZE; }
+
 		bf::Map* getNeighbor( Direction d ) { return m_neighbors[ d ].first; }
 		int getNeighborOffset( Direction d ) { return m_neighbors[ d ].second; }
 
@@ -63,11 +128,27 @@ namespace bf
 
 		bool adjustSprite( const Tmx::Layer& layer, sf::Vector2u pos, sf::Sprite& ) const;
 
+		// Returns the frame of a tile (frame.texture is null for an empty tile)
+		const TileFrame& getTileFrame( const Tmx::MapTile& tile ) const
+		{
+			unsigned gid = tile.tileset ? tile.tileset->GetFirstGid() + tile.id : 0U;
+			return gid < m_frames.size() ? m_frames[ gid ] : m_frames[ 0 ];
+		}
+
 	public: // Global variable
 		static Map& global();
 		static Map& global( unsigned id );
 		static Map& global( const std::string& map );
 		
+	private:
+		void packTilesets();
+		void indexObjects();
+		void listUpdating();
+		void buildCollision();
+		void selectLayers();
+		bool buildChunk( const std::vector< const Tmx::Layer* >& layers, unsigned x, unsigned y, Chunk& chunk ) const;
+		void buildChunks( const std::vector< const Tmx::Layer* >& layers, std::vector< Chunk >& chunks ) const;
+
 	private:
 		Tmx::Map m_map;
 		unsigned m_mapID;
@@ -75,14 +156,20 @@ namespace bf
 		time::Season m_season;
 
 		const Tmx::Layer* m_collision;
+		std::vector< sf::Uint32 > m_collisionBits; // One bit per tile, row-major
+		unsigned m_collisionRevision;
 		std::vector< const Tmx::Layer* > m_lower, m_upper;
-		std::unordered_map< const Tmx::Tileset*, std::shared_ptr< sf::Texture > > m_textures;
+		std::vector< std::unique_ptr< sf::Texture > > m_atlases;
+		std::vector< TileFrame > m_frames; // Indexed by gid; gid 0 is the empty tile
+		std::vector< Chunk > m_lowerChunks, m_upperChunks;
 
 		std::array< std::pair< bf::Map*, int >, 4 > m_neighbors;
 
 		// Map Objects
 		std::vector< Map::Object * > m_objects;
 		std::vector< Map::Object * > m_activeObjects;
+		std::vector< Map::Object * > m_updating; // Objects with an update callback, in order
+		util::SpatialGrid m_objectGrid;
 		
 		bool m_isExterior;
 	};
@@ -114,6 +201,9 @@ namespace bf
 		sf::FloatRect m_area;
 
 		std::vector< const Character* > m_characters;
+		mutable std::vector< std::size_t > m_visible;
+		mutable std::vector< Map::Object * > m_direct; // Visible objects that draw themselves
+		mutable gfx::SpriteBatch m_batch;
 	};
 
 	class MultiMapViewer : public MapViewer
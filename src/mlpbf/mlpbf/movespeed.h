@@ -1,6 +1,10 @@
 #pragma once
 
+#include <string>
+
 namespace bf
 {
 	enum MoveSpeed { Idle, Walk, Trot, Run };
+
+	const std::string strMoveSpeed( MoveSpeed m );
 }
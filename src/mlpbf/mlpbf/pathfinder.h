@@ -0,0 +1,116 @@
+#pragma once
+
+#include "direction.h"
+
+#include <SFML/Config.hpp>
+#include <SFML/System/NonCopyable.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include <array>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace bf
+{
+	class Map;
+
+	//-------------------------------------------------------------------------
+	// Finds 4-connected tile paths across a map's collision with A*
+	//
+	// A tile is walkable if neither the collision layer nor an object's collision covers its center
+	// Walkability is checked once per tile and kept, like found paths (cached by their endpoints),
+	// until the map's collision revision changes
+	//
+	// Routes between maps are planned over portals: each walkable run of edge tiles that crosses
+	// into a neighbor map is one portal, placed at the middle of the run
+	// A map's portals and the walking costs between them are cached until its collision,
+	// or the collision of a neighbor, changes
+	//-------------------------------------------------------------------------
+	class Pathfinder : public sf::NonCopyable
+	{
+	public:
+		// An edge tile to walk to, then step off of in dir to enter the neighbor map
+		struct Crossing
+		{
+			unsigned map;
+			sf::Vector2u tile;
+			Direction dir;
+		};
+
+		static Pathfinder& singleton();
+
+		// Fills path with the tiles to step through after from, ending with to
+		// Returns false (leaving path empty) if to can not be reached
+		bool find( const Map& map, const sf::Vector2u& from, const sf::Vector2u& to, std::vector< sf::Vector2u >& path );
+
+		// Fills route with the crossings to take, in order, to get from one map to another
+		// Returns false (leaving route empty) if to can not be reached
+		bool route( const Map& fromMap, const sf::Vector2u& from, const Map& toMap, const sf::Vector2u& to, std::vector< Crossing >& route );
+
+		void clearCache() { m_cache.clear(); m_portals.clear(); m_grids.clear(); }
+
+	private:
+		Pathfinder() : m_generation( 0U ), m_build( 0U ) {}
+
+		struct Portal;
+		struct MapPortals;
+		struct Grid;
+
+		Grid& getGrid( const Map& map );
+		bool isWalkable( const Map& map, Grid& grid, unsigned x, unsigned y ) const;
+		bool search( const Map& map, unsigned from, unsigned to );
+
+		unsigned cost( const Map& map, const sf::Vector2u& from, const sf::Vector2u& to );
+		MapPortals& getPortals( const Map& map );
+
+	private:
+		// Per-tile search state, only valid where stamp == m_generation
+		struct Node
+		{
+			unsigned stamp;
+			unsigned cost;
+			unsigned parent;
+			bool closed;
+		};
+
+		std::vector< Node > m_nodes;
+		std::vector< std::pair< unsigned, unsigned > > m_open; // ( estimated cost, tile ) heap
+		unsigned m_generation;
+		std::vector< sf::Vector2u > m_path;
+
+		typedef std::tuple< unsigned, unsigned, unsigned > Key; // ( map, from, to )
+		std::map< Key, std::pair< unsigned, std::vector< sf::Vector2u > > > m_cache; // revision, path
+
+		struct Portal
+		{
+			Crossing exit;
+			unsigned target;				// ID of the neighbor map
+			sf::Vector2u entry;				// Tile arrived on in the neighbor map
+			unsigned costsBuild;			// Build of the neighbor's portals the costs were measured against
+			std::vector< unsigned > costs;	// From entry to each of the neighbor's portals
+		};
+
+		struct MapPortals
+		{
+			std::array< unsigned, 5 > revisions; // The map's, then each neighbor's collision revision
+			unsigned build;
+			std::vector< Portal > portals;
+		};
+
+		std::map< unsigned, MapPortals > m_portals;
+		unsigned m_build;
+
+		// Walkability of a map's tiles, filled in as they are first checked
+		struct Grid
+		{
+			enum Tile { Unknown, Open, Blocked };
+
+			unsigned revision;
+			std::vector< sf::Uint8 > tiles; // Row-major
+		};
+
+		std::map< unsigned, Grid > m_grids;
+	};
+}
@@ -3,6 +3,7 @@
 #include <SFML/Audio/Music.hpp>
 #include <SFML/Audio/SoundBuffer.hpp>
 #include <SFML/Graphics/Font.hpp>
+#include <SFML/Graphics/Rect.hpp>
 #include <SFML/Graphics/Texture.hpp>
 
 #include <array>
@@ -21,11 +22,24 @@ namespace bf
 		typedef std::shared_ptr< sf::Music > 		MusicPtr;
 		typedef std::shared_ptr< sf::SoundBuffer > 	SoundBufferPtr;
 		typedef std::shared_ptr< sf::Texture > 		TexturePtr;
+
+		// An image packed into a shared atlas texture
+		struct Region
+		{
+			TexturePtr texture;
+			sf::IntRect rect;
+		};
+		typedef std::shared_ptr< const Region >		RegionPtr;
 		
 		FontPtr		loadFont( const std::string & filename );
 		MusicPtr		loadMusic( const std::string & filename );
 		SoundBufferPtr	loadSound( const std::string & filename );
 		TexturePtr	loadTexture( const std::string & filename );
+
+		// Packs the image into one of a few large atlas textures, so sprites from different files
+		// can be drawn together; images too big for an atlas get a texture of their own
+		// Regions stay loaded until cleanup(), and must not be drawn repeated
+		RegionPtr	loadRegion( const std::string & filename );
 		
 		template< std::size_t Size = 1 >
 		class FontLoader
@@ -57,5 +71,18 @@ namespace bf
 			sf::Texture& getTexture( std::size_t index = 0 ) { assert( m_texture[ index ] ); return *m_texture[ index ]; }
 			const sf::Texture& getTexture( std::size_t index = 0 ) const { assert( m_texture[ index ] ); return *m_texture[ index ]; }
 		};
+
+		template< std::size_t Size = 1 >
+		class RegionLoader
+		{
+			std::array< RegionPtr, Size > m_region;
+
+		public:
+			virtual ~RegionLoader() {}
+
+			void loadRegion( const std::string& file, std::size_t index = 0 ) { m_region.at( index ) = res::loadRegion( file ); }
+
+			const Region& getRegion( std::size_t index = 0 ) const { assert( m_region[ index ] ); return *m_region[ index ]; }
+		};
 	}
 }
@@ -30,8 +30,13 @@ namespace bf
 		//
 		// VIRTUAL FUNCTIONS
 		//
-		//	void update()
-		//		Updates the state
+		//	void update( const sf::Time& )
+		//		Advances the state by one fixed simulation step
+		//
+		//	void interpolate( float alpha )
+		//		Called once per rendered frame, before draw, with how far [0,1) the frame
+		//		lies between the last simulation step and the next one
+		//		Default: does nothing
 		//
 		//	void draw( sf::RenderTarget&, sf::RenderStates ) const
 		//		Draws the state
@@ -50,6 +55,7 @@ namespace bf
 
 			void handleEvents( const sf::Event& );
 			virtual void update( const sf::Time& ) = 0;
+			virtual void interpolate( float alpha ) {}
 		};
 
 		extern state::Base& global();
@@ -27,6 +27,7 @@ namespace bf
 
 		private:
 			void update( const sf::Time& );
+			void interpolate( float alpha );
 
 			void onKeyPressed( const sf::Event::KeyEvent& );
 			void onKeyReleased( const sf::Event::KeyEvent& );
@@ -44,6 +45,9 @@ namespace bf
 
 			// Boolean to update the player sprite if an input occured
 			bool m_updateSprite;
+
+			// Microseconds of the steps not yet passed to the map
+			sf::Int64 m_remainder;
 		};
 	}
 }
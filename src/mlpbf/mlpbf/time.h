@@ -3,6 +3,7 @@
 #include "time/date.h"
 #include "time/hour.h"
 #include "time/clock.h"
+#include "time/scheduler.h"
 #include <SFML/System/NonCopyable.hpp>
 
 namespace bf
@@ -14,6 +15,12 @@ namespace bf
 
 		bool update();
 
+		// Moves time forward in one jump, firing the scheduled callbacks that come due along the way
+		void advance( unsigned minutes );
+
+		// Advances to the next time the clock reads hour
+		void sleepUntil( const time::Hour& hour );
+
 		void setState( bool state ) { m_clock.setState( state ); }
 		bool getState() const { return m_clock.getState(); }
 
@@ -25,11 +32,28 @@ namespace bf
 		inline const time::Date & getDate() const { return m_date; }
 		inline const time::Hour & getHour() const { return m_hour; }
 
+		enum { MINUTES_PER_DAY = 24 * 60 };
+
+		// Returns the game-minute counter the scheduler runs on
+		unsigned getMinutes() const { return m_date.getRaw() * MINUTES_PER_DAY + m_hour.getRaw(); }
+
+		// Returns the game minute of the next time the clock reads hour (tomorrow if it already passed today)
+		unsigned getMinutes( const time::Hour& hour ) const;
+
+		inline time::Scheduler & getScheduler() { return m_scheduler; }
+
 	private:
 		Time();
 
+		// Moves time forward without touching the clock
+		void step( unsigned minutes );
+
 		time::Date m_date;
 		time::Hour m_hour;
 		time::Clock m_clock;
+		time::Scheduler m_scheduler;
+
+		unsigned m_pending; // Minutes left to step through
+		bool m_stepping;
 	};
 }
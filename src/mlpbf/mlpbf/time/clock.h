@@ -6,14 +6,16 @@ namespace bf
 {
 	namespace time
 	{
-		class Hour;
-
 		class Clock
 		{
 		public:
-			Clock( Hour& h );
+			Clock();
+
+			// Returns the number of game minutes that passed since the last update
+			unsigned update();
 
-			bool update();
+			// Starts counting the current minute over, e.g. after time was moved directly
+			void restart() { m_timer.restart(); }
 
 			void setState( bool state ) { m_timer.setState( state ); }
 			bool getState() const { return m_timer.getState(); }
@@ -21,7 +23,6 @@ namespace bf
 			void setTimescale( float amt );
 
 		private:
-			Hour& m_hour;
 			util::Timer m_timer;
 		};
 	}
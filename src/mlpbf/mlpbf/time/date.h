@@ -37,6 +37,8 @@ namespace bf
 			unsigned getDay() const; // [1, 30]
 			unsigned getYear() const;
 
+			unsigned getRaw() const { return m_day; } // Days since Spring 1 Year 1
+
 			const std::string toString() const;
 
 			int compareAbs( const Date& ) const; // Compares a date w/ regard to year
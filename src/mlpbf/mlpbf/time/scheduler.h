@@ -0,0 +1,77 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/System/NonCopyable.hpp>
+
+#include <array>
+#include <functional>
+#include <vector>
+
+namespace bf
+{
+	namespace time
+	{
+		//-------------------------------------------------------------------------
+		// Schedules callbacks on the game-minute counter (day * 1440 + minute of the day)
+		//
+		// Timers are kept in a hierarchical wheel of 4 levels of 64 slots, so each
+		// minute that passes costs one slot visit plus an occasional cascade,
+		// regardless of how many timers are waiting
+		//
+		// Callbacks may schedule and cancel timers, including their own
+		//-------------------------------------------------------------------------
+		class Scheduler : private sf::NonCopyable
+		{
+		public:
+			typedef sf::Uint32 Handle; // 0 is never a valid handle
+			typedef std::function< void() > Callback;
+
+			Scheduler( unsigned now = 0U );
+
+			// Calls fn once at an absolute game minute; minutes that already passed fire on the next one
+			Handle at( unsigned minute, const Callback& fn );
+
+			// Calls fn at an absolute game minute, then every period minutes until cancelled
+			Handle every( unsigned first, unsigned period, const Callback& fn );
+
+			// Returns false if the timer already fired or was cancelled
+			bool cancel( Handle h );
+
+			// Fires everything due up to and including now, in order
+			// Moving backwards reschedules the waiting timers without firing them
+			// Called from a callback, it extends the advance in progress instead
+			void advance( unsigned now );
+
+			unsigned now() const { return m_now; }
+			std::size_t size() const { return m_entries.size() - m_free.size(); }
+
+		private:
+			enum { BITS = 6, SLOTS = 1 << BITS, MASK = SLOTS - 1, LEVELS = 4 };
+
+			struct Entry
+			{
+				unsigned due;
+				unsigned period; // 0 fires once
+				sf::Uint16 generation;
+				bool active;
+				Callback fn;
+			};
+
+			Handle add( unsigned due, unsigned period, const Callback& fn );
+			void place( Handle h );
+			void release( sf::Uint32 index );
+			void cascade( int level );
+			void tick();
+
+			Entry* get( Handle h );
+
+		private:
+			unsigned m_now;
+			std::vector< Entry > m_entries;
+			std::vector< sf::Uint32 > m_free;
+			std::array< std::vector< Handle >, LEVELS * SLOTS > m_slots;
+			unsigned m_target;
+			bool m_ticking;
+		};
+	}
+}
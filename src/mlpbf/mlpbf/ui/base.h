@@ -12,7 +12,7 @@ namespace bf
 		class Base : public sf::Drawable, public sf::Transformable
 		{
 		public:
-			Base() : m_moving( false ) {}
+			Base() : m_moving( false ), m_timer( false, util::UI ) {}
 			virtual ~Base() {}
 
 			void update();
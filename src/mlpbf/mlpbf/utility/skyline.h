@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <SFML/System/Vector2.hpp>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// [UTILITY CLASS]
+		//	Packs rectangles into a fixed area by tracking its skyline: the top edge
+		//	of everything placed so far, as a list of horizontal segments
+		//	Each rect goes where its top ends up lowest (bottom-left rule)
+		//	Space is never given back; start over with clear()
+		//-------------------------------------------------------------------------
+		class Skyline
+		{
+		public:
+			Skyline( unsigned width, unsigned height ) : m_width( width ), m_height( height ) { clear(); }
+
+			void clear()
+			{
+				m_nodes.clear();
+				m_nodes.push_back( Node( 0U, 0U, m_width ) );
+			}
+
+			// Returns false if there is no room left for a width x height rect
+			bool insert( unsigned width, unsigned height, sf::Vector2u& pos )
+			{
+				std::size_t best = m_nodes.size();
+				unsigned bestTop = 0U, bestWidth = 0U;
+
+				for ( std::size_t i = 0; i < m_nodes.size(); i++ )
+				{
+					unsigned y;
+					if ( !fit( i, width, height, y ) )
+						continue;
+
+					if ( best == m_nodes.size() || y + height < bestTop || ( y + height == bestTop && m_nodes[ i ].width < bestWidth ) )
+					{
+						best = i;
+						bestTop = y + height;
+						bestWidth = m_nodes[ i ].width;
+					}
+				}
+
+				if ( best == m_nodes.size() )
+					return false;
+
+				pos = sf::Vector2u( m_nodes[ best ].x, bestTop - height );
+				m_nodes.insert( m_nodes.begin() + best, Node( pos.x, bestTop, width ) );
+
+				// Cut the segments now covered by the new one
+				for ( std::size_t i = best + 1; i < m_nodes.size(); )
+				{
+					const Node& prev = m_nodes[ i - 1 ];
+					Node& n = m_nodes[ i ];
+
+					if ( n.x >= prev.x + prev.width )
+						break;
+
+					unsigned shrink = prev.x + prev.width - n.x;
+					if ( n.width <= shrink )
+						m_nodes.erase( m_nodes.begin() + i );
+					else
+					{
+						n.x += shrink;
+						n.width -= shrink;
+						break;
+					}
+				}
+
+				// Join neighbouring segments at the same height
+				for ( std::size_t i = 0; i + 1 < m_nodes.size(); )
+				{
+					if ( m_nodes[ i ].y == m_nodes[ i + 1 ].y )
+					{
+						m_nodes[ i ].width += m_nodes[ i + 1 ].width;
+						m_nodes.erase( m_nodes.begin() + i + 1 );
+					}
+					else
+						i++;
+				}
+
+				return true;
+			}
+
+		private:
+			struct Node
+			{
+				Node( unsigned x, unsigned y, unsigned width ) : x( x ), y( y ), width( width ) {}
+				unsigned x, y, width;
+			};
+
+			// Finds the height a rect would rest at if its left edge was at node i
+			bool fit( std::size_t i, unsigned width, unsigned height, unsigned& y ) const
+			{
+				if ( m_nodes[ i ].x + width > m_width )
+					return false;
+
+				y = 0U;
+				for ( unsigned left = width; left > 0U; i++ )
+				{
+					y = std::max( y, m_nodes[ i ].y );
+					if ( y + height > m_height )
+						return false;
+					left -= std::min( left, m_nodes[ i ].width );
+				}
+				return true;
+			}
+
+		private:
+			unsigned m_width, m_height;
+			std::vector< Node > m_nodes;
+		};
+	}
+}
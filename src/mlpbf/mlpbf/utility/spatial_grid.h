@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <SFML/Graphics/Rect.hpp>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// [UTILITY CLASS]
+		//	A uniform grid that buckets indices by the cells their bounds overlap
+		//	Queries return the indices that may contain a point or intersect a rect,
+		//	sorted and without duplicates; callers still test the exact bounds
+		//	Bounds outside of the grid are clamped to the edge cells
+		//-------------------------------------------------------------------------
+		class SpatialGrid
+		{
+		public:
+			SpatialGrid() : m_cellSize( 1.0f ), m_columns( 0 ), m_rows( 0 ) {}
+
+			void reset( float width, float height, float cellSize )
+			{
+				m_cellSize = cellSize;
+				m_columns = std::max( 1, (int) std::ceil( width / cellSize ) );
+				m_rows = std::max( 1, (int) std::ceil( height / cellSize ) );
+
+				m_cells.clear();
+				m_cells.resize( m_columns * m_rows );
+			}
+
+			void insert( std::size_t index, const sf::FloatRect& bounds )
+			{
+				int left, top, right, bottom;
+				cells( bounds, left, top, right, bottom );
+
+				for ( int y = top; y <= bottom; y++ )
+					for ( int x = left; x <= right; x++ )
+						m_cells[ y * m_columns + x ].push_back( index );
+			}
+
+			void remove( std::size_t index, const sf::FloatRect& bounds )
+			{
+				int left, top, right, bottom;
+				cells( bounds, left, top, right, bottom );
+
+				for ( int y = top; y <= bottom; y++ )
+					for ( int x = left; x <= right; x++ )
+					{
+						std::vector< std::size_t >& cell = m_cells[ y * m_columns + x ];
+						cell.erase( std::remove( cell.begin(), cell.end(), index ), cell.end() );
+					}
+			}
+
+			void query( const sf::Vector2f& pos, std::vector< std::size_t >& out ) const
+			{
+				query( sf::FloatRect( pos.x, pos.y, 0.0f, 0.0f ), out );
+			}
+
+			void query( const sf::FloatRect& rect, std::vector< std::size_t >& out ) const
+			{
+				out.clear();
+				if ( m_cells.empty() ) return;
+
+				int left, top, right, bottom;
+				cells( rect, left, top, right, bottom );
+
+				for ( int y = top; y <= bottom; y++ )
+					for ( int x = left; x <= right; x++ )
+					{
+						const std::vector< std::size_t >& cell = m_cells[ y * m_columns + x ];
+						out.insert( out.end(), cell.begin(), cell.end() );
+					}
+
+				std::sort( out.begin(), out.end() );
+				out.erase( std::unique( out.begin(), out.end() ), out.end() );
+			}
+
+		private:
+			int clamp( float f, int max ) const
+			{
+				return std::min( max - 1, std::max( 0, (int) std::floor( f / m_cellSize ) ) );
+			}
+
+			void cells( const sf::FloatRect& rect, int& left, int& top, int& right, int& bottom ) const
+			{
+				left	= clamp( rect.left, m_columns );
+				top		= clamp( rect.top, m_rows );
+				right	= clamp( rect.left + rect.width, m_columns );
+				bottom	= clamp( rect.top + rect.height, m_rows );
+			}
+
+		private:
+			float m_cellSize;
+			int m_columns, m_rows;
+			std::vector< std::vector< std::size_t > > m_cells;
+		};
+	}
+}
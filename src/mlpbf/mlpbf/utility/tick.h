@@ -0,0 +1,65 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Time.hpp>
+
+#include <array>
+
+namespace bf
+{
+	namespace util
+	{
+		//-------------------------------------------------------------------------
+		// [UTILITY]
+		//	The time every util::Timer reads, advanced by the main loop instead of a system clock
+		//
+		//	Each domain counts microseconds separately, so the game world can be slowed down
+		//	or paused while the interface and real time keep running
+		//-------------------------------------------------------------------------
+		enum Domain
+		{
+			Real = 0,	// Wall time; never scaled or paused
+			Game,		// The world: maps, characters, animations and the game clock
+			UI,			// Menus, dialogue and other interface elements
+
+			DOMAIN_COUNT
+		};
+
+		namespace detail
+		{
+			struct TickDomain
+			{
+				TickDomain() : now( 0 ), scale( 1.0f ), paused( false ) {}
+
+				sf::Int64 now;
+				float scale;
+				bool paused;
+			};
+
+			inline std::array< TickDomain, DOMAIN_COUNT >& ticks()
+			{
+				static std::array< TickDomain, DOMAIN_COUNT > t;
+				return t;
+			}
+		}
+
+		// Current time of a domain, in microseconds
+		inline sf::Int64 now( Domain d ) { return detail::ticks()[ d ].now; }
+
+		// Moves a domain forward by t, scaled, unless it is paused
+		inline void advance( Domain d, const sf::Time& t )
+		{
+			detail::TickDomain& tick = detail::ticks()[ d ];
+			if ( d == Real )
+				tick.now += t.asMicroseconds();
+			else if ( !tick.paused )
+				tick.now += (sf::Int64) ( t.asMicroseconds() * tick.scale );
+		}
+
+		inline void setPaused( Domain d, bool paused ) { if ( d != Real ) detail::ticks()[ d ].paused = paused; }
+		inline bool isPaused( Domain d ) { return detail::ticks()[ d ].paused; }
+
+		inline void setScale( Domain d, float scale ) { if ( d != Real && scale >= 0.0f ) detail::ticks()[ d ].scale = scale; }
+		inline float getScale( Domain d ) { return detail::ticks()[ d ].scale; }
+	}
+}
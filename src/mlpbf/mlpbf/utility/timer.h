@@ -1,7 +1,9 @@
 #pragma once
 
 #include <algorithm>
-#include <SFML/System/Clock.hpp>
+#include <SFML/System/Time.hpp>
+
+#include "tick.h"
 
 namespace bf
 {
@@ -10,31 +12,47 @@ namespace bf
 		//-------------------------------------------------------------------------
 		// [UTILITY CLASS]
 		//	The timer keeps track of time until it hits a certain point
+		//	It counts in the time of its domain, so pausing the domain pauses the timer
 		//-------------------------------------------------------------------------
 		class Timer
 		{
 		public:
-			Timer( bool state = false ) : m_active( state ), m_clock(), m_offset( sf::milliseconds( 0 ) ), m_target( sf::milliseconds( 0 ) ) {}
+			Timer( bool state = false, Domain domain = Game ) : m_domain( domain ), m_active( state ), m_start( now( domain ) ), m_offset( 0 ), m_target( 0 ) {}
 
 			bool getState() const { return m_active; }
-			void setState( bool state ) { m_active = state; if ( !m_active ) m_offset = getElapsedTime(); else m_clock.restart(); }
+			void setState( bool state )
+			{
+				if ( m_active && !state )
+					m_offset = elapsed();
+				else if ( !m_active && state )
+					m_start = now( m_domain );
+				m_active = state;
+			}
+
+			void setTarget( const sf::Time& target ) { m_target = target.asMicroseconds(); restart(); }
 
-			void setTarget( const sf::Time& target ) { m_target = target; restart(); }
+			const sf::Time getElapsedTime() const { return sf::microseconds( elapsed() ); }
+			const sf::Time getRemainingTime() const { return sf::microseconds( m_target - elapsed() ); }
 
-			const sf::Time getElapsedTime() const { return ( m_active ) ? m_clock.getElapsedTime() + m_offset : m_offset; }
-			const sf::Time getRemainingTime() const { return m_target - getElapsedTime(); }
+			float getPercent() const { return m_target > 0 ? std::min( 1.0f, (float) elapsed() / m_target ) : 1.0f; }
 
-			float getPercent() const { return std::min( 1.0f, (float) getElapsedTime().asMilliseconds() / m_target.asMilliseconds() ); }
+			sf::Time restart() { sf::Int64 t = elapsed(); m_start = now( m_domain ); m_offset = 0; return sf::microseconds( t ); }
 
-			sf::Time restart() { sf::Time t = getElapsedTime(); m_clock.restart(); m_offset = sf::milliseconds( 0 ); return t; }
+			// Takes t off the elapsed time, keeping whatever passed beyond it
+			void consume( const sf::Time& t ) { if ( m_active ) m_start += t.asMicroseconds(); else m_offset -= t.asMicroseconds(); }
 
-			bool finished() const { return getElapsedTime() >= m_target; }
+			bool finished() const { return elapsed() >= m_target; }
 			operator bool() const { return finished(); }
 
+			Domain getDomain() const { return m_domain; }
+
+		private:
+			sf::Int64 elapsed() const { return m_active ? now( m_domain ) - m_start + m_offset : m_offset; }
+
 		private:
+			Domain m_domain;
 			bool m_active;
-			sf::Clock m_clock;
-			sf::Time m_offset, m_target;
+			sf::Int64 m_start, m_offset, m_target;
 		};
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,322 @@
+#include "mlpbf/pathfinder.h"
+
+#include "mlpbf/database.h"
+#include "mlpbf/global.h"
+#include "mlpbf/map.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+
+namespace bf
+{
+
+static const std::size_t MAX_CACHED_PATHS = 256;
+static const unsigned UNREACHABLE = ~0U;
+
+inline unsigned heuristic( unsigned a, unsigned b, unsigned width )
+{
+	int dx = (int) ( a % width ) - (int) ( b % width );
+	int dy = (int) ( a / width ) - (int) ( b / width );
+	return std::abs( dx ) + std::abs( dy );
+}
+
+// Finds the ith tile along the edge of map facing d, and the tile it crosses into on the neighbor
+inline bool edgeTiles( const Map& map, const Map& next, Direction d, int offset, unsigned i, sf::Vector2u& exit, sf::Vector2i& entry )
+{
+	switch ( d )
+	{
+	case Up:	exit = sf::Vector2u( i, 0 );						entry = sf::Vector2i( i + offset, next.getHeight() - 1 ); break;
+	case Down:	exit = sf::Vector2u( i, map.getHeight() - 1 );	entry = sf::Vector2i( i + offset, 0 ); break;
+	case Left:	exit = sf::Vector2u( 0, i );						entry = sf::Vector2i( next.getWidth() - 1, i + offset ); break;
+	case Right:	exit = sf::Vector2u( map.getWidth() - 1, i );	entry = sf::Vector2i( 0, i + offset ); break;
+	}
+	return 0 <= entry.x && entry.x < (int) next.getWidth() && 0 <= entry.y && entry.y < (int) next.getHeight();
+}
+
+/***************************************************************************/
+
+Pathfinder& Pathfinder::singleton()
+{
+	static Pathfinder p;
+	return p;
+}
+
+bool Pathfinder::find( const Map& map, const sf::Vector2u& from, const sf::Vector2u& to, std::vector< sf::Vector2u >& path )
+{
+	path.clear();
+
+	const unsigned width = map.getWidth(), height = map.getHeight();
+	if ( from.x >= width || from.y >= height || to.x >= width || to.y >= height )
+		return false;
+
+	const unsigned start = from.y * width + from.x, goal = to.y * width + to.x;
+
+	// Reuse the last path between these tiles if the map's collision hasn't changed
+	Key key( map.getID(), start, goal );
+	auto find = m_cache.find( key );
+	if ( find != m_cache.end() && find->second.first == map.getCollisionRevision() )
+	{
+		path = find->second.second;
+		return start == goal || !path.empty();
+	}
+
+	if ( start != goal && search( map, start, goal ) )
+	{
+		for ( unsigned i = goal; i != start; i = m_nodes[ i ].parent )
+			path.push_back( sf::Vector2u( i % width, i / width ) );
+		std::reverse( path.begin(), path.end() );
+	}
+
+	if ( m_cache.size() >= MAX_CACHED_PATHS )
+		m_cache.clear();
+	m_cache[ key ] = std::make_pair( map.getCollisionRevision(), path );
+
+	return start == goal || !path.empty();
+}
+
+Pathfinder::Grid& Pathfinder::getGrid( const Map& map )
+{
+	Grid& grid = m_grids[ map.getID() ];
+	if ( grid.tiles.size() != map.getWidth() * map.getHeight() || grid.revision != map.getCollisionRevision() )
+	{
+		grid.revision = map.getCollisionRevision();
+		grid.tiles.assign( map.getWidth() * map.getHeight(), Grid::Unknown );
+	}
+	return grid;
+}
+
+bool Pathfinder::isWalkable( const Map& map, Grid& grid, unsigned x, unsigned y ) const
+{
+	// Object collision may run a script, so each tile is only checked once per revision
+	sf::Uint8& tile = grid.tiles[ y * map.getWidth() + x ];
+	if ( tile == Grid::Unknown )
+	{
+		sf::Vector2f center( ( x + 0.5f ) * TILE_WIDTH, ( y + 0.5f ) * TILE_HEIGHT );
+		bool walkable = map.isWalkable( sf::Vector2u( x, y ) ) && !map.checkObjectCollision( center );
+		tile = walkable ? Grid::Open : Grid::Blocked;
+	}
+	return tile == Grid::Open;
+}
+
+bool Pathfinder::search( const Map& map, unsigned start, unsigned goal )
+{
+	const unsigned width = map.getWidth(), height = map.getHeight();
+	Grid& grid = getGrid( map );
+
+	if ( !isWalkable( map, grid, goal % width, goal / width ) )
+		return false;
+
+	// Start a new generation instead of clearing every node
+	if ( m_nodes.size() < width * height )
+		m_nodes.resize( width * height, Node() );
+	if ( ++m_generation == 0U )
+	{
+		for ( Node& n : m_nodes )
+			n.stamp = 0U;
+		m_generation = 1U;
+	}
+
+	auto visit = [&]( unsigned i, unsigned cost, unsigned parent )
+	{
+		Node& n = m_nodes[ i ];
+		if ( n.stamp == m_generation && ( n.closed || n.cost <= cost ) )
+			return;
+
+		n.stamp = m_generation;
+		n.cost = cost;
+		n.parent = parent;
+		n.closed = false;
+
+		m_open.push_back( std::make_pair( cost + heuristic( i, goal, width ), i ) );
+		std::push_heap( m_open.begin(), m_open.end(), std::greater< std::pair< unsigned, unsigned > >() );
+	};
+
+	m_open.clear();
+	visit( start, 0U, start );
+
+	while ( !m_open.empty() )
+	{
+		std::pop_heap( m_open.begin(), m_open.end(), std::greater< std::pair< unsigned, unsigned > >() );
+		unsigned i = m_open.back().second;
+		m_open.pop_back();
+
+		Node& n = m_nodes[ i ];
+		if ( n.closed )
+			continue;
+		n.closed = true;
+
+		if ( i == goal )
+			return true;
+
+		unsigned x = i % width, y = i / width, cost = n.cost + 1U;
+		if ( y > 0U && isWalkable( map, grid, x, y - 1U ) )			visit( i - width, cost, i );
+		if ( y + 1U < height && isWalkable( map, grid, x, y + 1U ) )	visit( i + width, cost, i );
+		if ( x > 0U && isWalkable( map, grid, x - 1U, y ) )			visit( i - 1U, cost, i );
+		if ( x + 1U < width && isWalkable( map, grid, x + 1U, y ) )	visit( i + 1U, cost, i );
+	}
+
+	return false;
+}
+
+/***************************************************************************/
+
+unsigned Pathfinder::cost( const Map& map, const sf::Vector2u& from, const sf::Vector2u& to )
+{
+	return find( map, from, to, m_path ) ? (unsigned) m_path.size() : UNREACHABLE;
+}
+
+Pathfinder::MapPortals& Pathfinder::getPortals( const Map& map )
+{
+	std::array< unsigned, 5 > revisions;
+	revisions[ 0 ] = map.getCollisionRevision();
+	for ( int d = Up; d <= Right; d++ )
+	{
+		const Map * next = map.getNeighbor( (Direction) d );
+		revisions[ d + 1 ] = next ? next->getCollisionRevision() : 0U;
+	}
+
+	auto find = m_portals.find( map.getID() );
+	if ( find != m_portals.end() && find->second.revisions == revisions )
+		return find->second;
+
+	MapPortals& portals = m_portals[ map.getID() ];
+	portals.revisions = revisions;
+	portals.build = ++m_build;
+	portals.portals.clear();
+
+	for ( int d = Up; d <= Right; d++ )
+	{
+		const Map * next = map.getNeighbor( (Direction) d );
+		if ( !next )
+			continue;
+
+		const int offset = map.getNeighborOffset( (Direction) d );
+		Grid& grid = getGrid( map );
+		Grid& nextGrid = getGrid( *next );
+		const unsigned length = ( d == Up || d == Down ) ? map.getWidth() : map.getHeight();
+
+		// Find each run of edge tiles that can be crossed and place a portal in its middle
+		unsigned start = 0U;
+		bool run = false;
+		for ( unsigned i = 0; i <= length; i++ )
+		{
+			sf::Vector2u exit;
+			sf::Vector2i entry;
+			bool open = i < length && edgeTiles( map, *next, (Direction) d, offset, i, exit, entry ) &&
+						isWalkable( map, grid, exit.x, exit.y ) && isWalkable( *next, nextGrid, entry.x, entry.y );
+
+			if ( open && !run )
+			{
+				start = i;
+				run = true;
+			}
+			else if ( !open && run )
+			{
+				run = false;
+
+				Portal portal;
+				edgeTiles( map, *next, (Direction) d, offset, ( start + i - 1 ) / 2, exit, entry );
+				portal.exit.map = map.getID();
+				portal.exit.tile = exit;
+				portal.exit.dir = (Direction) d;
+				portal.target = next->getID();
+				portal.entry = sf::Vector2u( entry );
+				portal.costsBuild = 0U;
+				portals.portals.push_back( portal );
+			}
+		}
+	}
+
+	return portals;
+}
+
+bool Pathfinder::route( const Map& fromMap, const sf::Vector2u& from, const Map& toMap, const sf::Vector2u& to, std::vector< Crossing >& route )
+{
+	route.clear();
+
+	// Dijkstra over the portals; a node is ( map ID, portal index )
+	typedef std::pair< unsigned, unsigned > Node;
+	const Node START( UNREACHABLE, 0U ), GOAL( UNREACHABLE, 1U );
+
+	std::map< Node, std::pair< unsigned, Node > > best; // cost, previous node
+	std::vector< std::pair< unsigned, Node > > open;
+
+	auto relax = [&]( const Node& node, unsigned cost, const Node& previous )
+	{
+		auto find = best.find( node );
+		if ( find != best.end() && find->second.first <= cost )
+			return;
+
+		best[ node ] = std::make_pair( cost, previous );
+		open.push_back( std::make_pair( cost, node ) );
+		std::push_heap( open.begin(), open.end(), std::greater< std::pair< unsigned, Node > >() );
+	};
+
+	// Walk from the start to the goal directly, or to any portal of the starting map
+	if ( fromMap.getID() == toMap.getID() )
+	{
+		unsigned c = cost( fromMap, from, to );
+		if ( c != UNREACHABLE )
+			relax( GOAL, c, START );
+	}
+
+	MapPortals& first = getPortals( fromMap );
+	for ( unsigned i = 0; i < first.portals.size(); i++ )
+	{
+		unsigned c = cost( fromMap, from, first.portals[ i ].exit.tile );
+		if ( c != UNREACHABLE )
+			relax( Node( fromMap.getID(), i ), c, START );
+	}
+
+	while ( !open.empty() )
+	{
+		std::pop_heap( open.begin(), open.end(), std::greater< std::pair< unsigned, Node > >() );
+		unsigned c = open.back().first;
+		Node node = open.back().second;
+		open.pop_back();
+
+		if ( c > best[ node ].first )
+			continue;
+		if ( node == GOAL )
+			break;
+
+		Portal& portal = m_portals[ node.first ].portals[ node.second ];
+		const Map& next = db::getMap( portal.target );
+		const unsigned arrive = c + 1U; // Stepping over the edge
+
+		if ( portal.target == toMap.getID() )
+		{
+			unsigned last = cost( next, portal.entry, to );
+			if ( last != UNREACHABLE )
+				relax( GOAL, arrive + last, node );
+		}
+
+		// Measure the walk to each of the neighbor's portals once per build of them
+		MapPortals& portals = getPortals( next );
+		if ( portal.costsBuild != portals.build )
+		{
+			portal.costs.clear();
+			for ( const Portal& p : portals.portals )
+				portal.costs.push_back( cost( next, portal.entry, p.exit.tile ) );
+			portal.costsBuild = portals.build;
+		}
+
+		for ( unsigned i = 0; i < portal.costs.size(); i++ )
+			if ( portal.costs[ i ] != UNREACHABLE )
+				relax( Node( portal.target, i ), arrive + portal.costs[ i ], node );
+	}
+
+	if ( best.find( GOAL ) == best.end() )
+		return false;
+
+	for ( Node node = best[ GOAL ].second; node != START; node = best[ node ].second )
+		route.push_back( m_portals[ node.first ].portals[ node.second ].exit );
+	std::reverse( route.begin(), route.end() );
+
+	return true;
+}
+
+/***************************************************************************/
+
+} // namespace bf
@@ -1,11 +1,15 @@
 #include "mlpbf/resource.h"
 #include "mlpbf/exception.h"
+#include "mlpbf/utility/skyline.h"
 
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <unordered_map>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <SFML/Graphics/Image.hpp>
 #include <SFML/System/NonCopyable.hpp>
 
 namespace bf
@@ -103,12 +107,95 @@ class TextureManager : public ResourceManager< sf::Texture >
 
 /***************************************************************************/
 
+class AtlasManager : private sf::NonCopyable
+{
+	enum
+	{
+		PAGE_MAX_SIZE = 1024,
+		PADDING = 1 // Transparent pixels kept between images so filtering doesn't bleed
+	};
+
+	struct Page
+	{
+		Page( unsigned size ) : texture( new sf::Texture() ), skyline( size, size ) {}
+
+		TexturePtr texture;
+		util::Skyline skyline;
+	};
+
+public:
+	AtlasManager() : m_pageSize( std::min( sf::Texture::getMaximumSize(), (unsigned) PAGE_MAX_SIZE ) ) {}
+
+	RegionPtr load( const std::string & file )
+	{
+		auto find = m_regions.find( file );
+		if ( find != m_regions.end() )
+			return find->second;
+
+		sf::Image image;
+		if ( !image.loadFromFile( file ) )
+			throw TextureLoadException( file );
+
+		std::shared_ptr< Region > region( new Region() );
+		const sf::Vector2u size = image.getSize();
+
+		if ( size.x + PADDING > m_pageSize / 2 || size.y + PADDING > m_pageSize / 2 )
+		{
+			// Too big to share a page with much else
+			region->texture = TexturePtr( new sf::Texture() );
+			if ( !region->texture->loadFromImage( image ) )
+				throw TextureLoadException( file );
+			region->rect = sf::IntRect( 0, 0, size.x, size.y );
+		}
+		else
+		{
+			sf::Vector2u pos;
+			Page& page = allocate( size.x + PADDING, size.y + PADDING, pos );
+
+			page.texture->update( image, pos.x, pos.y );
+			region->texture = page.texture;
+			region->rect = sf::IntRect( pos.x, pos.y, size.x, size.y );
+		}
+
+		m_regions.insert( std::make_pair( file, region ) );
+		return region;
+	}
+
+private:
+	Page& allocate( unsigned width, unsigned height, sf::Vector2u& pos )
+	{
+		for ( std::unique_ptr< Page >& page : m_pages )
+			if ( page->skyline.insert( width, height, pos ) )
+				return *page;
+
+		// Start a new, cleared page
+		sf::Image blank;
+		blank.create( m_pageSize, m_pageSize, sf::Color( 0, 0, 0, 0 ) );
+
+		m_pages.push_back( std::unique_ptr< Page >( new Page( m_pageSize ) ) );
+		Page& page = *m_pages.back();
+		if ( !page.texture->loadFromImage( blank ) )
+			throw Exception( "Failed to create texture atlas" );
+
+		page.skyline.insert( width, height, pos );
+		return page;
+	}
+
+private:
+	unsigned m_pageSize;
+	std::vector< std::unique_ptr< Page > > m_pages;
+	std::unordered_map< std::string, RegionPtr > m_regions;
+} * g_AtlasManager = NULL;
+
+/***************************************************************************/
+
 void init()
 {
 	g_FontManager		= new FontManager();
 	g_MusicManager		= new MusicManager();
 	g_SoundManager		= new SoundManager();
 	g_TextureManager	= new TextureManager();
+	g_AtlasManager		= new AtlasManager();
 }
 
 void cleanup()
@@ -117,11 +204,13 @@ void cleanup()
 	delete g_MusicManager;
 	delete g_SoundManager;
 	delete g_TextureManager;
+	delete g_AtlasManager;
 	
 	g_FontManager 		= NULL;
 	g_MusicManager 	= NULL;
 	g_SoundManager 	= NULL;
 	g_TextureManager 	= NULL;
+	g_AtlasManager		= NULL;
 }
 
 /***************************************************************************/
@@ -150,6 +239,12 @@ TexturePtr loadTexture( const std::string & str )
 	return g_TextureManager->load( str );
 }
 
+RegionPtr loadRegion( const std::string & str )
+{
+	assert( g_AtlasManager != NULL );
+	return g_AtlasManager->load( str );
+}
+
 /***************************************************************************/
 
 } // namespace res
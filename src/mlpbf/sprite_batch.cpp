@@ -0,0 +1,138 @@
+#include "mlpbf/graphics/sprite_batch.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Graphics/Texture.hpp>
+
+namespace bf
+{
+namespace gfx
+{
+
+/***************************************************************************/
+
+// Maps a float onto an unsigned integer with the same ordering
+inline sf::Uint32 orderedBits( float f )
+{
+	sf::Uint32 u;
+	std::memcpy( &u, &f, sizeof( u ) );
+	return ( u & 0x80000000U ) ? ~u : ( u | 0x80000000U );
+}
+
+/***************************************************************************/
+
+void SpriteBatch::add( const sf::Sprite& sprite, const sf::Transform& transform, sf::Uint8 layer )
+{
+	if ( !sprite.getTexture() )
+		return;
+
+	const sf::Transform t = transform * sprite.getTransform();
+	const sf::FloatRect local = sprite.getLocalBounds();
+	const sf::IntRect& tex = sprite.getTextureRect();
+	const sf::Color& color = sprite.getColor();
+
+	Sprite s;
+	s.texture = sprite.getTexture();
+
+	const float left = (float) tex.left, top = (float) tex.top;
+	const float right = (float) ( tex.left + tex.width ), bottom = (float) ( tex.top + tex.height );
+
+	s.quad[ 0 ] = sf::Vertex( t.transformPoint( 0.0f, 0.0f ), color, sf::Vector2f( left, top ) );
+	s.quad[ 1 ] = sf::Vertex( t.transformPoint( 0.0f, local.height ), color, sf::Vector2f( left, bottom ) );
+	s.quad[ 2 ] = sf::Vertex( t.transformPoint( local.width, local.height ), color, sf::Vector2f( right, bottom ) );
+	s.quad[ 3 ] = sf::Vertex( t.transformPoint( local.width, 0.0f ), color, sf::Vector2f( right, top ) );
+
+	// Textures are numbered in the order they are first seen this batch
+	sf::Uint32 texture = std::find( m_textures.begin(), m_textures.end(), s.texture ) - m_textures.begin();
+	if ( texture == m_textures.size() )
+		m_textures.push_back( s.texture );
+
+	// Everything on the ground is flat, so only its texture matters
+	const sf::FloatRect bounds = t.transformRect( local );
+	const sf::Uint32 depth = ( layer == Ground ) ? 0U : orderedBits( bounds.top + bounds.height );
+	const sf::Uint64 key = ( (sf::Uint64) layer << 56 ) | ( (sf::Uint64) depth << 24 ) | ( texture & 0xFFFFFFU );
+
+	m_keys.push_back( std::make_pair( key, (sf::Uint32) m_sprites.size() ) );
+	m_sprites.push_back( s );
+}
+
+void SpriteBatch::sort()
+{
+	// LSD radix sort, a byte at a time; bytes every key shares are skipped
+	const std::size_t n = m_keys.size();
+	m_swap.resize( n );
+
+	for ( unsigned shift = 0; shift < 64; shift += 8 )
+	{
+		std::size_t counts[ 256 ] = {};
+		for ( const auto& k : m_keys )
+			counts[ ( k.first >> shift ) & 0xFF ]++;
+
+		if ( counts[ ( m_keys[ 0 ].first >> shift ) & 0xFF ] == n )
+			continue;
+
+		std::size_t offset = 0;
+		for ( std::size_t& c : counts )
+		{
+			std::size_t count = c;
+			c = offset;
+			offset += count;
+		}
+
+		for ( const auto& k : m_keys )
+			m_swap[ counts[ ( k.first >> shift ) & 0xFF ]++ ] = k;
+		m_keys.swap( m_swap );
+	}
+}
+
+void SpriteBatch::flush( sf::RenderTarget& target, sf::RenderStates states, sf::Uint8 last )
+{
+	if ( !m_keys.empty() )
+		sort();
+
+	// Keys are sorted by layer first, so the ones to draw are a prefix
+	std::size_t end = 0;
+	while ( end < m_keys.size() && ( m_keys[ end ].first >> 56 ) <= last )
+		end++;
+
+	if ( end > 0 )
+	{
+		m_vertices.clear();
+		const sf::Texture* texture = m_sprites[ m_keys[ 0 ].second ].texture;
+
+		for ( std::size_t i = 0; i <= end; i++ )
+		{
+			const Sprite* s = i < end ? &m_sprites[ m_keys[ i ].second ] : nullptr;
+
+			// Draw the finished run once the texture changes
+			if ( !s || s->texture != texture )
+			{
+				states.texture = texture;
+				target.draw( &m_vertices[ 0 ], m_vertices.size(), sf::Quads, states );
+				m_vertices.clear();
+
+				if ( !s )
+					break;
+				texture = s->texture;
+			}
+
+			m_vertices.insert( m_vertices.end(), s->quad, s->quad + 4 );
+		}
+	}
+
+	m_keys.erase( m_keys.begin(), m_keys.begin() + end );
+	if ( m_keys.empty() )
+	{
+		m_sprites.clear();
+		m_textures.clear();
+	}
+}
+
+/***************************************************************************/
+
+} // namespace gfx
+
+} // namespace bf
@@ -12,7 +12,6 @@ namespace bf
 namespace gfx
 {
 
-bool Spritesheet::s_active = true;
 
 class AnimationNotFoundException : public Exception
 {
@@ -26,78 +25,80 @@ public:
 /***************************************************************************/
 
 Spritesheet::Spritesheet() :
-	m_curAnim( nullptr ),
-	m_loop( false )
+	m_record( Animator::singleton().add() )
 {
 }
 
 Spritesheet::Spritesheet( const std::string& sprite ) :
-	m_curAnim( nullptr ),
-	m_loop( false )
+	m_record( Animator::singleton().add() )
 {
 	load( sprite );
 }
 
-/***************************************************************************/
+Spritesheet::Spritesheet( const Spritesheet& other ) :
+	m_animations( other.m_animations ),
+	m_record( Animator::singleton().add() )
+{
+	Animator::singleton().copy( m_record, other.m_record );
+}
 
-void Spritesheet::addAnimation( const std::string& str, std::unique_ptr< Animation > anim )
+Spritesheet::~Spritesheet()
 {
-	//TODO: check if already exists
-	m_animations.insert( std::make_pair( str, std::move( anim ) ) );
+	Animator::singleton().remove( m_record );
 }
 
+Spritesheet& Spritesheet::operator=( const Spritesheet& other )
+{
+	m_animations = other.m_animations;
+	Animator::singleton().copy( m_record, other.m_record );
+
+	return *this;
+}
+
+/***************************************************************************/
+
 void Spritesheet::animate( const std::string& anim, bool loop )
 {
-	auto find = m_animations.find( anim );
-	if ( find == m_animations.end() )
+	const Animation* find = m_animations ? m_animations->find( anim ) : nullptr;
+	if ( !find )
 		throw AnimationNotFoundException( anim );
 
-	m_curAnim = find->second.get();
-	m_loop = loop;
-	m_frame = 0;
+	play( find, loop );
+}
 
-	m_timer.restart();
-	m_curAnim->setTimer( m_timer );
+void Spritesheet::animate( Direction d, MoveSpeed m, bool loop )
+{
+	const Animation* find = m_animations ? m_animations->find( d, m ) : nullptr;
+	if ( !find )
+		throw AnimationNotFoundException( strDirection( d ) + "." + strMoveSpeed( m ) );
+
+	play( find, loop );
 }
 
 void Spritesheet::load( const std::string& sprite )
 {
-	m_animations.clear();
-	db::genSprite( sprite, this );
+	Animator::singleton().play( m_record, nullptr, false );
+	m_animations = db::getAnimations( sprite );
+}
+
+void Spritesheet::play( const Animation* anim, bool loop )
+{
+	Animator::singleton().play( m_record, anim, loop );
 }
 
 bool Spritesheet::finished() const
 {
-	if ( m_loop )
-		return false;
-	else
-		return m_curAnim != nullptr && m_timer && m_frame == m_curAnim->getNumFrames() - 1;
+	const Animator::Record& r = Animator::singleton().get( m_record );
+	return r.anim != nullptr && !r.loop && r.finished;
 }
 
 /***************************************************************************/
 
 sf::Sprite& Spritesheet::update( sf::Sprite& sprite ) const
 {
-	if ( m_curAnim )
-	{
-		const Animation& anim = *m_curAnim;
-
-		if ( s_active != m_timer.getState() )
-			m_timer.setState( s_active );
-
-		// Timer has finished
-		if ( s_active && m_timer )
-		{
-			if ( m_loop )
-				m_frame = ( m_frame + 1 ) % anim.getNumFrames();
-			else if ( m_frame < anim.getNumFrames() )
-				m_frame++;
-
-			m_timer.restart();
-		}
-
-		anim.update( sprite, m_frame );
-	}
+	const Animator::Record& r = Animator::singleton().get( m_record );
+	if ( r.anim )
+		r.anim->update( sprite, r.frame );
 
 	return sprite;
 }
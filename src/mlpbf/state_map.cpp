@@ -41,7 +41,8 @@ state::Map::Map() :
 	m_dir( Player::singleton().getDirection() ),
 	m_moving( false ),
 	m_speedModifier( Default ),
-	m_updateSprite( true )
+	m_updateSprite( true ),
+	m_remainder( 0 )
 {
 	setKeyListener( *this );
 
@@ -322,11 +323,21 @@ void state::Map::update( const sf::Time& time )
 	if ( player.getMapID() != m_viewer.map().getID() )
 		m_viewer.map( bf::Map::global( player.getMapID() ) );
 
-	// Center the map on the player
-	m_viewer.center( player.getPosition() );
+	// Update the current map in whole milliseconds, carrying what is left of the step to the next one
+	sf::Int64 us = time.asMicroseconds() + m_remainder;
+	m_remainder = us % 1000;
+	map.update( (sf::Uint32) ( us / 1000 ), player.getPosition() );
+}
+
+void state::Map::interpolate( float alpha )
+{
+	Player& player = Player::singleton();
+
+	player.interpolate( alpha );
+	rarity->interpolate( alpha );
 
-	// Update the current map
-	map.update( time.asMilliseconds(), player.getPosition() );
+	// Center the map on where the player is drawn
+	m_viewer.center( player.getDrawPosition() );
 }
 
 void state::Map::draw( sf::RenderTarget& target, sf::RenderStates states ) const
@@ -87,22 +87,29 @@ public:
 
 static const sf::Time CLOCK_UPDATE_INTERVAL = sf::milliseconds( 500 );
 
-Clock::Clock( Hour& h ) :
-	m_hour( h )
+Clock::Clock()
 {
 	m_timer.setTarget( CLOCK_UPDATE_INTERVAL );
 	m_timer.setState( true );
 }
 
-bool Clock::update()
+unsigned Clock::update()
 {
-	if ( m_timer )
+	if ( !m_timer )
+		return 0U;
+
+	// A high timescale can pass several minutes in one frame
+	sf::Int64 interval = ( m_timer.getElapsedTime() + m_timer.getRemainingTime() ).asMicroseconds();
+	if ( interval <= 0 )
 	{
-		m_hour.increment( 1 );
 		m_timer.restart();
-		return true;
+		return 1U;
 	}
-	return false;
+
+	// Carry the part of a minute left over into the next one, so time doesn't drift behind
+	unsigned minutes = (unsigned) ( m_timer.getElapsedTime().asMicroseconds() / interval );
+	m_timer.consume( sf::microseconds( minutes * interval ) );
+	return minutes;
 }
 
 void Clock::setTimescale( float amt )
@@ -528,6 +535,202 @@ Seasons parseSeasons( std::string str )
 	return bit;
 }
 
+/***************************************************************************/
+//	mlpbf/time/scheduler.h
+
+static const unsigned HANDLE_INDEX_BITS = 20;
+static const sf::Uint32 HANDLE_INDEX_MASK = ( 1U << HANDLE_INDEX_BITS ) - 1;
+static const sf::Uint16 HANDLE_GENERATION_MASK = ( 1U << ( 32 - HANDLE_INDEX_BITS ) ) - 1;
+
+Scheduler::Scheduler( unsigned now ) :
+	m_now( now ),
+	m_target( now ),
+	m_ticking( false )
+{
+}
+
+Scheduler::Handle Scheduler::at( unsigned minute, const Callback& fn )
+{
+	return add( std::max( minute, m_now + 1 ), 0U, fn );
+}
+
+Scheduler::Handle Scheduler::every( unsigned first, unsigned period, const Callback& fn )
+{
+	if ( period == 0U )
+		throw Exception( "Scheduler period must be greater than 0" );
+	return add( std::max( first, m_now + 1 ), period, fn );
+}
+
+bool Scheduler::cancel( Handle h )
+{
+	if ( get( h ) == nullptr )
+		return false;
+	release( h & HANDLE_INDEX_MASK );
+	return true;
+}
+
+void Scheduler::advance( unsigned now )
+{
+	// A callback moving time forward extends the advance that is firing it
+	if ( m_ticking )
+	{
+		m_target = std::max( m_target, now );
+		return;
+	}
+
+	if ( now < m_now )
+	{
+		// Time went backwards; empty the wheel and place everything again from the new minute
+		m_now = now;
+
+		std::vector< Handle > waiting;
+		for ( std::vector< Handle >& slot : m_slots )
+		{
+			waiting.insert( waiting.end(), slot.begin(), slot.end() );
+			slot.clear();
+		}
+
+		for ( Handle h : waiting )
+			if ( Entry* e = get( h ) )
+			{
+				e->due = std::max( e->due, m_now + 1 );
+				place( h );
+			}
+		return;
+	}
+
+	m_target = now;
+	m_ticking = true;
+	while ( m_now < m_target )
+		tick();
+	m_ticking = false;
+}
+
+Scheduler::Handle Scheduler::add( unsigned due, unsigned period, const Callback& fn )
+{
+	sf::Uint32 index;
+	if ( !m_free.empty() )
+	{
+		index = m_free.back();
+		m_free.pop_back();
+	}
+	else
+	{
+		if ( m_entries.size() > HANDLE_INDEX_MASK )
+			throw Exception( "Too many scheduled timers" );
+
+		index = m_entries.size();
+		Entry e;
+		e.generation = 1;
+		m_entries.push_back( e );
+	}
+
+	Entry& e = m_entries[ index ];
+	e.due = due;
+	e.period = period;
+	e.active = true;
+	e.fn = fn;
+
+	Handle h = ( (Handle) e.generation << HANDLE_INDEX_BITS ) | index;
+	place( h );
+	return h;
+}
+
+void Scheduler::place( Handle h )
+{
+	const Entry& e = m_entries[ h & HANDLE_INDEX_MASK ];
+
+	// Timers past the top level wait in its furthest slot and are placed again as it cascades
+	unsigned delta = e.due - m_now;
+	unsigned due = delta < ( 1U << ( BITS * LEVELS ) ) ? e.due : m_now + ( 1U << ( BITS * LEVELS ) ) - 1;
+
+	int level = 0;
+	while ( level < LEVELS - 1 && delta >= ( 1U << ( BITS * ( level + 1 ) ) ) )
+		level++;
+
+	m_slots[ level * SLOTS + ( ( due >> ( BITS * level ) ) & MASK ) ].push_back( h );
+}
+
+void Scheduler::release( sf::Uint32 index )
+{
+	Entry& e = m_entries[ index ];
+	e.active = false;
+	e.fn = nullptr;
+
+	// Skip generation 0 so a handle is never 0
+	e.generation = ( e.generation + 1 ) & HANDLE_GENERATION_MASK;
+	if ( e.generation == 0 )
+		e.generation = 1;
+
+	m_free.push_back( index );
+}
+
+void Scheduler::cascade( int level )
+{
+	std::vector< Handle > slot;
+	slot.swap( m_slots[ level * SLOTS + ( ( m_now >> ( BITS * level ) ) & MASK ) ] );
+
+	for ( Handle h : slot )
+		if ( get( h ) != nullptr )
+			place( h );
+}
+
+void Scheduler::tick()
+{
+	m_now++;
+
+	// Pull the timers of the next block down a level each time a lower level wraps around
+	for ( int level = 1; level < LEVELS && ( m_now & ( ( 1U << ( BITS * level ) ) - 1 ) ) == 0; level++ )
+		cascade( level );
+
+	std::vector< Handle >& slot = m_slots[ m_now & MASK ];
+	if ( slot.empty() )
+		return;
+
+	std::vector< Handle > due;
+	due.swap( slot );
+
+	for ( Handle h : due )
+	{
+		Entry* e = get( h );
+		if ( e == nullptr )
+			continue;
+
+		if ( e->due != m_now )
+		{
+			place( h );
+			continue;
+		}
+
+		// The callback may add timers, so don't hold onto the entry while it runs
+		sf::Uint32 index = h & HANDLE_INDEX_MASK;
+		if ( e->period == 0U )
+		{
+			Callback fn = std::move( e->fn );
+			release( index );
+			fn();
+		}
+		else
+		{
+			e->due += e->period;
+			place( h );
+
+			Callback fn = e->fn;
+			fn();
+		}
+	}
+}
+
+Scheduler::Entry* Scheduler::get( Handle h )
+{
+	sf::Uint32 index = h & HANDLE_INDEX_MASK;
+	if ( index >= m_entries.size() )
+		return nullptr;
+
+	Entry& e = m_entries[ index ];
+	return e.active && e.generation == ( h >> HANDLE_INDEX_BITS ) ? &e : nullptr;
+}
+
 } // namespace time
 
 /***************************************************************************/
@@ -542,19 +745,63 @@ Time& Time::singleton()
 Time::Time() :
 	m_date( 0 ),
 	m_hour( time::DAWN ),
-	m_clock( m_hour )
+	m_clock(),
+	m_scheduler( getMinutes() ),
+	m_pending( 0U ),
+	m_stepping( false )
 {
 }
 
 bool Time::update()
 {
-	bool updated = m_clock.update();
-	if ( updated )
+	unsigned minutes = m_clock.update();
+	if ( minutes > 0U )
+		step( minutes );
+	else
+		m_scheduler.advance( getMinutes() ); // Catches the date or hour being set directly
+
+	return minutes > 0U;
+}
+
+void Time::advance( unsigned minutes )
+{
+	step( minutes );
+
+	if ( minutes > 1U )
+		m_clock.restart();
+}
+
+void Time::step( unsigned minutes )
+{
+	// A callback moving time forward extends the step that is firing it
+	m_pending += minutes;
+	if ( m_stepping )
+		return;
+
+	// Set the clock to each minute before firing what came due in it,
+	// so callbacks see their own time and schedule relative to it
+	m_stepping = true;
+	for ( ; m_pending > 0U; m_pending-- )
 	{
-		if ( m_hour == time::MIDNIGHT )
-			m_date.increment( 1 );
+		unsigned now = getMinutes() + 1;
+
+		m_date.set( now / MINUTES_PER_DAY );
+		m_hour.set( now % MINUTES_PER_DAY / 60, now % 60 );
+
+		m_scheduler.advance( now );
 	}
-	return updated;
+	m_stepping = false;
+}
+
+void Time::sleepUntil( const time::Hour& hour )
+{
+	advance( getMinutes( hour ) - getMinutes() );
+}
+
+unsigned Time::getMinutes( const time::Hour& hour ) const
+{
+	unsigned minutes = m_date.getRaw() * MINUTES_PER_DAY + hour.getRaw();
+	return hour > m_hour ? minutes : minutes + MINUTES_PER_DAY;
 }
 
 /***************************************************************************/
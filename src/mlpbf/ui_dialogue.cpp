@@ -116,7 +116,8 @@ public:
 		m_parent( parent ),
 		m_index( 0U ),
 		m_updateTime( DIALOGUE_UPDATE_TIME ),
-		m_updateMod( 1.0f )
+		m_updateMod( 1.0f ),
+		m_timer( false, util::UI )
 	{
 		m_timer.setTarget( m_updateTime * m_updateMod );
 		m_timer.setState( true );
@@ -401,6 +402,10 @@ class SpeedModifier : public RuntimeModifier
 
 class PauseModifier : public RuntimeModifier 
 {
+public:
+	PauseModifier() : m_timer( false, util::UI ) {}
+
+private:
 	void parse( const std::vector< std::string >& args )
 	{
 		m_init = false;